@@ -19,6 +19,7 @@
 #define GLM_FORCE_SWIZZLE
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/packing.hpp"
 #include "glm/gtx/io.hpp"
 #include "glm/gtx/string_cast.hpp"
 
@@ -30,10 +31,56 @@
 #include <string>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <future>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include <cmath>
+#include <cstdint>
+#include <climits>
+#include <cfloat>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#endif
+
+// SIMD intrinsics for ImageKernels, the instruction set is picked at runtime
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define IMAGE_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define KERNEL_TARGET(isa)
+#else
+#define KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
 
 // forward declaration of functions
 void printGLContextInfo();
 void printGLError();
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start);
 
 // print OpenGL context related information
 void printGLContextInfo() {
@@ -76,3 +123,8 @@ void printGLError() {
         std::cout << "GL_ERROR (" << std::hex << code << std::dec << ")" << std::endl;
     }
 }
+
+// milliseconds passed since start, used for the load time reports
+double elapsedMilliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
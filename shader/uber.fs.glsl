@@ -0,0 +1,80 @@
+#version 410 core
+
+// permutation defines are inserted after the version line by ShaderLibrary:
+// HAS_TEXTURE    modulate the material with textureMap
+// TEXTURE_ARRAY  textureMap is a layer of a texture array, with HAS_TEXTURE
+// NUM_LIGHTS     number of lights evaluated, at most MAX_LIGHTS
+// MAX_LIGHTS     size of the light array in LightData
+
+in vec3 position;
+in vec3 normal;
+#ifdef HAS_TEXTURE
+in vec2 textureCoordinate;
+#endif
+
+layout (location = 0) out vec4 color;
+
+struct Light {
+    vec3 position;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct Material {
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    float shininess;
+};
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPosition;
+};
+
+layout (std140) uniform LightData {
+    Light lights[MAX_LIGHTS];
+};
+
+#ifdef TEXTURE_ARRAY
+uniform sampler2DArray textureMap;
+uniform float textureLayer;
+uniform vec4 textureTransform; // scale in xy and offset in zw of the image inside its layer
+#elif defined(HAS_TEXTURE)
+uniform sampler2D textureMap;
+#endif
+uniform Material material;
+
+void main(void) {
+#ifdef TEXTURE_ARRAY
+    vec2 layerCoordinate = textureCoordinate * textureTransform.xy + textureTransform.zw;
+    vec3 textureColor = texture(textureMap, vec3(layerCoordinate, textureLayer)).rgb;
+#elif defined(HAS_TEXTURE)
+    vec3 textureColor = texture(textureMap, textureCoordinate).rgb;
+#else
+    vec3 textureColor = vec3(1.0);
+#endif
+
+    vec3 normalizedNormal = normalize(normal);
+    vec3 viewDirection = normalize(cameraPosition - position);
+
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < NUM_LIGHTS; ++i) {
+        // ambient
+        vec3 ambient = material.ambient * textureColor;
+
+        // diffuse
+        vec3 lightDirection = normalize(lights[i].position - position);
+        vec3 diffuse = max(dot(normalizedNormal, lightDirection), 0.0) * textureColor * material.diffuse;
+
+        // specular
+        vec3 halfwayDirection = normalize(lightDirection + viewDirection);
+        vec3 specular = pow(max(dot(normalizedNormal, halfwayDirection), 0.0), material.shininess) * material.specular;
+
+        result += ambient * lights[i].ambient + diffuse * lights[i].diffuse + specular * lights[i].specular;
+    }
+
+    color = vec4(result, 1.0);
+}
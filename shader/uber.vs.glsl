@@ -0,0 +1,65 @@
+#version 410 core
+
+// permutation defines are inserted after the version line by ShaderLibrary:
+// HAS_TEXTURE    pass the texture coordinate on to the fragment shader
+// QUANTIZED      the vertices use a quantized VertexLayout and are decoded here
+
+layout (location = 0) in vec3 inPosition;
+#ifdef QUANTIZED
+layout (location = 1) in vec2 inNormal; // octahedral
+#else
+layout (location = 1) in vec3 inNormal;
+#endif
+#ifdef HAS_TEXTURE
+layout (location = 2) in vec2 inTexture;
+#endif
+
+out vec3 position;
+out vec3 normal;
+#ifdef HAS_TEXTURE
+out vec2 textureCoordinate;
+#endif
+
+uniform mat4 model;
+uniform mat3 normalMatrix;
+#ifdef QUANTIZED
+// positions and texture coordinates are stored relative to the bounds of the mesh
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+uniform vec4 texcoordTransform; // scale in xy and offset in zw
+#endif
+
+layout (std140) uniform FrameData {
+    mat4 projection;
+    mat4 view;
+    vec3 cameraPosition;
+};
+
+#ifdef QUANTIZED
+// the lower half of the octahedron is folded over the diagonals, same as VertexDecode::decodeNormal
+vec3 decodeNormal(vec2 encoded) {
+    vec3 n = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+#endif
+
+void main(void) {
+#ifdef QUANTIZED
+    vec3 vertexPosition = inPosition * positionScale + positionOffset;
+    vec3 vertexNormal = decodeNormal(inNormal);
+#else
+    vec3 vertexPosition = inPosition;
+    vec3 vertexNormal = inNormal;
+#endif
+    position = vec3(model * vec4(vertexPosition, 1.0));
+    normal = normalMatrix * vertexNormal;
+#if defined(HAS_TEXTURE) && defined(QUANTIZED)
+    textureCoordinate = inTexture * texcoordTransform.xy + texcoordTransform.zw;
+#elif defined(HAS_TEXTURE)
+    textureCoordinate = inTexture;
+#endif
+
+    gl_Position = projection * view * model * vec4(vertexPosition, 1.0);
+}
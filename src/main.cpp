@@ -1,11 +1,242 @@
 #include "Common.h"
 
+// typed handle to a uniform location, resolved once through Shader::getUniform
+template<typename T>
+struct Uniform {
+    GLint location = -1;
+    static bool accepts(GLenum type);
+};
+template<> bool Uniform<bool>::accepts(GLenum type) { return type == GL_BOOL; }
+template<> bool Uniform<int>::accepts(GLenum type) { return type == GL_INT || type == GL_BOOL || type == GL_SAMPLER_2D || type == GL_SAMPLER_2D_ARRAY; }
+template<> bool Uniform<float>::accepts(GLenum type) { return type == GL_FLOAT; }
+template<> bool Uniform<glm::vec2>::accepts(GLenum type) { return type == GL_FLOAT_VEC2; }
+template<> bool Uniform<glm::vec3>::accepts(GLenum type) { return type == GL_FLOAT_VEC3; }
+template<> bool Uniform<glm::vec4>::accepts(GLenum type) { return type == GL_FLOAT_VEC4; }
+template<> bool Uniform<glm::mat2>::accepts(GLenum type) { return type == GL_FLOAT_MAT2; }
+template<> bool Uniform<glm::mat3>::accepts(GLenum type) { return type == GL_FLOAT_MAT3; }
+template<> bool Uniform<glm::mat4>::accepts(GLenum type) { return type == GL_FLOAT_MAT4; }
+
+// cache of the bound GL state, every bind goes through here so calls that change nothing are skipped
+class RenderState {
+public:
+    static const GLuint MAX_TEXTURE_UNITS = 16;
+
+    static RenderState& get() {
+        static RenderState state;
+        return state;
+    }
+
+    // bind calls that reached the driver / were dropped as redundant, for the current and the last frame
+    unsigned long issued = 0;
+    unsigned long skipped = 0;
+    unsigned long lastFrameIssued = 0;
+    unsigned long lastFrameSkipped = 0;
+
+    void useProgram(GLuint program) {
+        if (!changed(currentProgram, program))
+            return;
+        glUseProgram(program);
+    }
+    void bindVertexArray(GLuint vao) {
+        if (!changed(currentVertexArray, vao))
+            return;
+        glBindVertexArray(vao);
+    }
+    // unit is left active even when the bind is skipped, callers edit the texture of the unit right after
+    void bindTexture(GLuint unit, GLenum target, GLuint texture) {
+        activeTexture(unit);
+        if (!changed(textures[unit][targetIndex(target)], texture))
+            return;
+        glBindTexture(target, texture);
+    }
+    void bindSampler(GLuint unit, GLuint sampler) {
+        if (!changed(samplers[unit], sampler))
+            return;
+        glBindSampler(unit, sampler);
+    }
+    // glDeleteTextures unbinds the texture from every unit, keep the cache in sync
+    void forgetTexture(GLuint texture) {
+        for (auto& unit : textures) {
+            for (auto& bound : unit) {
+                if (bound == texture)
+                    bound = 0;
+            }
+        }
+    }
+    // glDeleteVertexArrays unbinds a bound vertex array
+    void forgetVertexArray(GLuint vao) {
+        if (currentVertexArray == vao)
+            currentVertexArray = 0;
+    }
+    // GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND, other capabilities have no slot in the cache
+    void setEnabled(GLenum capability, bool enabled) {
+        const int index = capabilityIndex(capability);
+        if (index < 0) {
+            std::cout << "ERROR::RENDER_STATE::UNSUPPORTED_CAPABILITY: 0x" << std::hex << capability << std::dec << std::endl;
+            return;
+        }
+        GLuint& current = capabilities[index];
+        if (!changed(current, enabled ? GL_TRUE : GL_FALSE))
+            return;
+        if (enabled)
+            glEnable(capability);
+        else
+            glDisable(capability);
+    }
+    void depthFunc(GLenum func) {
+        if (!changed(currentDepthFunc, func))
+            return;
+        glDepthFunc(func);
+    }
+    void cullFace(GLenum mode) {
+        if (!changed(currentCullFace, mode))
+            return;
+        glCullFace(mode);
+    }
+    void frontFace(GLenum mode) {
+        if (!changed(currentFrontFace, mode))
+            return;
+        glFrontFace(mode);
+    }
+    // forget everything, needed after code that bypasses the cache touched GL state
+    void invalidate() {
+        *this = RenderState(issued, skipped, lastFrameIssued, lastFrameSkipped);
+    }
+    void endFrame() {
+        lastFrameIssued = issued;
+        lastFrameSkipped = skipped;
+        issued = skipped = 0;
+    }
+
+private:
+    static const GLuint UNKNOWN = ~0u;
+    static const int TEXTURE_TARGETS = 3;
+    static const int CAPABILITIES = 3;
+
+    GLuint currentProgram = UNKNOWN;
+    GLuint currentVertexArray = UNKNOWN;
+    GLuint currentActiveTexture = UNKNOWN;
+    GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGETS];
+    GLuint samplers[MAX_TEXTURE_UNITS];
+    GLuint capabilities[CAPABILITIES];
+    GLuint currentDepthFunc = UNKNOWN;
+    GLuint currentCullFace = UNKNOWN;
+    GLuint currentFrontFace = UNKNOWN;
+
+    RenderState() {
+        for (auto& unit : textures)
+            std::fill(std::begin(unit), std::end(unit), UNKNOWN);
+        std::fill(std::begin(samplers), std::end(samplers), UNKNOWN);
+        std::fill(std::begin(capabilities), std::end(capabilities), UNKNOWN);
+    }
+    RenderState(unsigned long issued, unsigned long skipped, unsigned long lastFrameIssued, unsigned long lastFrameSkipped):
+            RenderState() {
+        this->issued = issued;
+        this->skipped = skipped;
+        this->lastFrameIssued = lastFrameIssued;
+        this->lastFrameSkipped = lastFrameSkipped;
+    }
+
+    // update the cached value and count the call, returns false if the call can be skipped
+    bool changed(GLuint& current, GLuint value) {
+        if (current == value) {
+            ++skipped;
+            return false;
+        }
+        current = value;
+        ++issued;
+        return true;
+    }
+    void activeTexture(GLuint unit) {
+        if (currentActiveTexture == unit)
+            return;
+        currentActiveTexture = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    static int targetIndex(GLenum target) {
+        switch (target) {
+        case GL_TEXTURE_2D_ARRAY:
+            return 1;
+        case GL_TEXTURE_CUBE_MAP:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+    static int capabilityIndex(GLenum capability) {
+        switch (capability) {
+        case GL_DEPTH_TEST:
+            return 0;
+        case GL_CULL_FACE:
+            return 1;
+        case GL_BLEND:
+            return 2;
+        default:
+            return -1;
+        }
+    }
+};
+
+// fixed binding points of the uniform blocks shared by every program
+enum UniformBlockBinding : GLuint {
+    FRAME_DATA_BINDING = 0,
+    LIGHT_DATA_BINDING = 1,
+};
+static const std::unordered_map<std::string, GLuint> UNIFORM_BLOCK_BINDINGS = {
+    {"FrameData", FRAME_DATA_BINDING},
+    {"LightData", LIGHT_DATA_BINDING},
+};
+// per frame camera data, matches the std140 FrameData block
+// vec3 members are padded to 16 bytes in std140, so they are stored as vec4
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::vec4 cameraPosition;
+};
+// one light, matches the Light struct of the std140 LightData block
+struct LightSource {
+    glm::vec4 position;
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+};
+// scene lights, matches the std140 LightData block
+struct LightData {
+    static const int MAX_LIGHTS = 4;
+    LightSource lights[MAX_LIGHTS];
+};
+// uniform buffer holding one std140 block, bound once to its binding point
+template<typename T>
+class UniformBuffer {
+public:
+    GLuint ubo = 0;
+    const GLuint binding;
+
+    explicit UniformBuffer(GLuint binding): binding(binding) {
+        glGenBuffers(1, &ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, ubo);
+    }
+    ~UniformBuffer() {
+        glDeleteBuffers(1, &ubo);
+    }
+
+    void update(const T& data) const {
+        glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &data);
+    }
+};
+
 class Shader {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // called once the program is ready, to set up uniforms that never change
+    std::function<void(Shader&)> onFinalize;
+    // constructor generates the shader on the fly, defines are inserted after the #version line
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr) {
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr,
+           const std::string& defines = "") {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
@@ -42,96 +273,354 @@ public:
         } catch (std::ifstream::failure& e) {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ" << std::endl;
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment, geometry;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, nullptr);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, nullptr);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        if (geometryPath != nullptr) {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, nullptr);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader materialShader
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if (geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our materialShader now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        vertexCode = insertDefines(vertexCode, defines);
+        fragmentCode = insertDefines(fragmentCode, defines);
         if (geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+            geometryCode = insertDefines(geometryCode, defines);
+        name = std::string(vertexPath) + "\", \"" + fragmentPath;
+        if (!defines.empty())
+            name += "\" [" + permutationName(defines) + "]";
+        submitTime = std::chrono::steady_clock::now();
+        ID = glCreateProgram();
+        // 2. reuse the program binary of a previous run, whether the driver accepts it is checked in finalize()
+        cachePath = binaryCachePath(vertexCode + '\0' + fragmentCode + '\0' + geometryCode);
+        sources = {vertexCode, fragmentCode, geometryCode};
+        hasGeometry = geometryPath != nullptr;
+        fromBinary = loadBinary(cachePath);
+        if (!fromBinary) {
+            // 3. submit the shaders, with parallel compile support the driver compiles them on its own threads
+            submit();
+        }
+    }
+    ~Shader() {
+        for (auto& pending : pendingShaders)
+            glDeleteShader(pending.first);
+        glDeleteProgram(ID);
+    }
+    // let the driver compile on as many threads as it likes, call before creating shaders
+    // ------------------------------------------------------------------------
+    static void enableParallelCompile() {
+        if (GLEW_KHR_parallel_shader_compile)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        else if (GLEW_ARB_parallel_shader_compile)
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    // true once compiling and linking finished, never waits for the driver
+    // ------------------------------------------------------------------------
+    bool isReady() const {
+        if (finalized)
+            return true;
+        // without parallel compile support the status query is the wait, so report ready
+        if (!GLEW_KHR_parallel_shader_compile && !GLEW_ARB_parallel_shader_compile)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
+    }
+    // wait for the program, check the results and build the uniform table,
+    // done automatically on first use
+    // ------------------------------------------------------------------------
+    void finalize() {
+        if (finalized)
+            return;
+        finalized = true;
+        if (fromBinary) {
+            GLint success = GL_FALSE;
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+            if (!success) {
+                std::cout << "Program binary \"" << cachePath << "\" rejected by the driver, compiling from source" << std::endl;
+                // start over with a fresh program object, the failed one keeps its error state
+                glDeleteProgram(ID);
+                ID = glCreateProgram();
+                fromBinary = false;
+                submit();
+            }
+        }
+        if (!fromBinary) {
+            for (auto& pending : pendingShaders) {
+                checkCompileErrors(pending.first, pending.second);
+                glDetachShader(ID, pending.first);
+                glDeleteShader(pending.first);
+            }
+            pendingShaders.clear();
+            checkCompileErrors(ID, "PROGRAM");
+            saveBinary(cachePath);
+        }
+        sources = {};
+        // 4. build the uniform table once, so setting uniforms never asks the driver again
+        loadUniforms();
+        std::cout << "Loaded shader \"" << name << "\" " << (fromBinary ? "from binary cache" : "from source")
+                  << ", ready " << elapsedMilliseconds(submitTime) << " ms after submit" << std::endl;
+        if (onFinalize)
+            onFinalize(*this);
     }
     // activate the materialShader
     // ------------------------------------------------------------------------
-    void use() const {
-        glUseProgram(ID);
+    void use() {
+        finalize();
+        RenderState::get().useProgram(ID);
+    }
+    // look up a uniform location in the table built at link time, -1 if it is not active
+    // ------------------------------------------------------------------------
+    GLint getUniformLocation(const std::string &name) {
+        finalize();
+        auto it = uniforms.find(name);
+        return it != uniforms.end() ? it->second.location : -1;
+    }
+    // resolve a typed uniform handle once, so the render loop only passes integers around
+    // ------------------------------------------------------------------------
+    template<typename T>
+    Uniform<T> getUniform(const std::string &name) {
+        finalize();
+        auto it = uniforms.find(name);
+        if (it == uniforms.end())
+            return {};
+        if (!Uniform<T>::accepts(it->second.type))
+            std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+        return {it->second.location};
+    }
+    // typed uniform functions
+    // ------------------------------------------------------------------------
+    static void set(Uniform<bool> uniform, bool value) {
+        glUniform1i(uniform.location, (int)value);
+    }
+    static void set(Uniform<int> uniform, int value) {
+        glUniform1i(uniform.location, value);
+    }
+    static void set(Uniform<float> uniform, float value) {
+        glUniform1f(uniform.location, value);
+    }
+    static void set(Uniform<glm::vec2> uniform, const glm::vec2 &value) {
+        glUniform2fv(uniform.location, 1, &value[0]);
+    }
+    static void set(Uniform<glm::vec3> uniform, const glm::vec3 &value) {
+        glUniform3fv(uniform.location, 1, &value[0]);
     }
-    // utility uniform functions
+    static void set(Uniform<glm::vec4> uniform, const glm::vec4 &value) {
+        glUniform4fv(uniform.location, 1, &value[0]);
+    }
+    static void set(Uniform<glm::mat2> uniform, const glm::mat2 &mat) {
+        glUniformMatrix2fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    static void set(Uniform<glm::mat3> uniform, const glm::mat3 &mat) {
+        glUniformMatrix3fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    static void set(Uniform<glm::mat4> uniform, const glm::mat4 &mat) {
+        glUniformMatrix4fv(uniform.location, 1, GL_FALSE, &mat[0][0]);
+    }
+    // utility uniform functions, looked up by name in the uniform table
     // ------------------------------------------------------------------------
-    void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    void setBool(const std::string &name, bool value) {
+        glUniform1i(getUniformLocation(name), (int)value);
     }
     // ------------------------------------------------------------------------
-    void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    void setInt(const std::string &name, int value) {
+        glUniform1i(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
-    void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    void setFloat(const std::string &name, float value) {
+        glUniform1f(getUniformLocation(name), value);
     }
     // ------------------------------------------------------------------------
-    void setVec2(const std::string &name, const glm::vec2 &value) const {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void setVec2(const std::string &name, const glm::vec2 &value) {
+        glUniform2fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec2(const std::string &name, float x, float y) const {
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+    void setVec2(const std::string &name, float x, float y) {
+        glUniform2f(getUniformLocation(name), x, y);
     }
     // ------------------------------------------------------------------------
-    void setVec3(const std::string &name, const glm::vec3 &value) const {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void setVec3(const std::string &name, const glm::vec3 &value) {
+        glUniform3fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec3(const std::string &name, float x, float y, float z) const {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+    void setVec3(const std::string &name, float x, float y, float z) {
+        glUniform3f(getUniformLocation(name), x, y, z);
     }
     // ------------------------------------------------------------------------
-    void setVec4(const std::string &name, const glm::vec4 &value) const {
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+    void setVec4(const std::string &name, const glm::vec4 &value) {
+        glUniform4fv(getUniformLocation(name), 1, &value[0]);
     }
-    void setVec4(const std::string &name, float x, float y, float z, float w) const {
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+    void setVec4(const std::string &name, float x, float y, float z, float w) {
+        glUniform4f(getUniformLocation(name), x, y, z, w);
     }
     // ------------------------------------------------------------------------
-    void setMat2(const std::string &name, const glm::mat2 &mat) const {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void setMat2(const std::string &name, const glm::mat2 &mat) {
+        glUniformMatrix2fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat3(const std::string &name, const glm::mat3 &mat) const {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void setMat3(const std::string &name, const glm::mat3 &mat) {
+        glUniformMatrix3fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
-    void setMat4(const std::string &name, const glm::mat4 &mat) const {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    void setMat4(const std::string &name, const glm::mat4 &mat) {
+        glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
 private:
+    // directory of the program binary cache, created next to the executable by the build
+    static constexpr const char* BINARY_CACHE_DIR = "cache/";
+    static const uint32_t BINARY_CACHE_MAGIC = 0x42505347; // "GSPB"
+    static const uint32_t BINARY_CACHE_VERSION = 1;
+
+    struct BinaryCacheHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    std::string name;
+    std::string cachePath;
+    std::chrono::steady_clock::time_point submitTime;
+    bool fromBinary = false;
+    bool finalized = false;
+    // sources and shader objects of a program compiled from source, released once it is finalized
+    std::vector<std::string> sources;
+    bool hasGeometry = false;
+    std::vector<std::pair<GLuint, std::string>> pendingShaders;
+
+    struct UniformInfo {
+        GLint location;
+        GLenum type;
+        GLint size;
+    };
+    std::unordered_map<std::string, UniformInfo> uniforms;
+
+    // the #version directive has to stay the first line, so defines go right after it
+    // ------------------------------------------------------------------------
+    static std::string insertDefines(const std::string& code, const std::string& defines) {
+        if (defines.empty())
+            return code;
+        size_t versionLine = code.find("#version");
+        size_t position = versionLine == std::string::npos ? 0 : code.find('\n', versionLine);
+        if (position == std::string::npos)
+            return code + "\n" + defines;
+        if (versionLine != std::string::npos)
+            ++position;
+        return code.substr(0, position) + defines + code.substr(position);
+    }
+    // "#define A\n#define B 1\n" -> "A B=1", for the load report
+    // ------------------------------------------------------------------------
+    static std::string permutationName(const std::string& defines) {
+        std::istringstream lines(defines);
+        std::string line, result;
+        while (std::getline(lines, line)) {
+            std::istringstream words(line);
+            std::string directive, macro, value;
+            words >> directive >> macro >> value;
+            if (!result.empty())
+                result += ' ';
+            result += value.empty() ? macro : macro + "=" + value;
+        }
+        return result;
+    }
+    // compile and link the program from source without waiting for the results
+    // ------------------------------------------------------------------------
+    void submit() {
+        const GLenum types[] = {GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, GL_GEOMETRY_SHADER};
+        const char* typeNames[] = {"VERTEX", "FRAGMENT", "GEOMETRY"};
+        for (int i = 0; i < (hasGeometry ? 3 : 2); ++i) {
+            const char* code = sources[i].c_str();
+            GLuint shader = glCreateShader(types[i]);
+            glShaderSource(shader, 1, &code, nullptr);
+            glCompileShader(shader);
+            glAttachShader(ID, shader);
+            pendingShaders.emplace_back(shader, typeNames[i]);
+        }
+        glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(ID);
+    }
+    // binaries are only valid for the exact driver that produced them,
+    // so the cache key covers the sources and the GL vendor/renderer/version
+    // ------------------------------------------------------------------------
+    static std::string binaryCachePath(const std::string& sources) {
+        std::string key = sources;
+        for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            const GLubyte* value = glGetString(name);
+            key += '\0';
+            if (value)
+                key += reinterpret_cast<const char*>(value);
+        }
+        // 64-bit FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : key) {
+            hash ^= c;
+            hash *= 1099511628211ull;
+        }
+        char name[17];
+        snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+        return std::string(BINARY_CACHE_DIR) + name + ".bin";
+    }
+    // hand a cached program binary to the driver, returns false if there is none
+    // ------------------------------------------------------------------------
+    bool loadBinary(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return false;
+        BinaryCacheHeader header{};
+        file.read(reinterpret_cast<char*>(&header), sizeof(header));
+        if (!file || header.magic != BINARY_CACHE_MAGIC || header.version != BINARY_CACHE_VERSION)
+            return false;
+        std::vector<char> binary(header.length);
+        file.read(binary.data(), header.length);
+        if (!file)
+            return false;
+        glProgramBinary(ID, header.format, binary.data(), static_cast<GLsizei>(header.length));
+        return true;
+    }
+    // store the linked program binary for the next run
+    // ------------------------------------------------------------------------
+    void saveBinary(const std::string& path) const {
+        GLint formats = 0, length = 0, success = GL_FALSE;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        glGetProgramiv(ID, GL_LINK_STATUS, &success);
+        glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (formats == 0 || !success || length <= 0)
+            return;
+        std::vector<char> binary(length);
+        BinaryCacheHeader header{BINARY_CACHE_MAGIC, BINARY_CACHE_VERSION, 0, 0};
+        GLenum format = 0;
+        glGetProgramBinary(ID, length, &length, &format, binary.data());
+        header.format = format;
+        header.length = static_cast<uint32_t>(length);
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+            return;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+    }
+    // query every active uniform of the linked program with glGetActiveUniform
+    // ------------------------------------------------------------------------
+    void loadUniforms() {
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> nameBuffer(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; ++i) {
+            GLsizei length = 0;
+            UniformInfo info{};
+            glGetActiveUniform(ID, static_cast<GLuint>(i), maxLength, &length, &info.size, &info.type, nameBuffer.data());
+            std::string name(nameBuffer.data(), length);
+            info.location = glGetUniformLocation(ID, name.c_str());
+            if (info.location < 0) // uniforms inside a uniform block have no location
+                continue;
+            uniforms[name] = info;
+            // arrays are reported as "name[0]", also make them reachable as "name"
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+                uniforms[name.substr(0, name.size() - 3)] = info;
+        }
+        // attach the shared uniform blocks to their fixed binding points
+        GLint blockCount = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+        for (GLint i = 0; i < blockCount; ++i) {
+            GLchar blockName[256];
+            glGetActiveUniformBlockName(ID, static_cast<GLuint>(i), sizeof(blockName), nullptr, blockName);
+            auto it = UNIFORM_BLOCK_BINDINGS.find(blockName);
+            if (it != UNIFORM_BLOCK_BINDINGS.end())
+                glUniformBlockBinding(ID, static_cast<GLuint>(i), it->second);
+            else
+                std::cout << "ERROR::SHADER::UNKNOWN_UNIFORM_BLOCK: " << blockName << std::endl;
+        }
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     static void checkCompileErrors(GLuint shader, const std::string& type) {
@@ -152,6 +641,58 @@ private:
         }
     }
 };
+// feature set of a program built from the uber shader, every field turns into a #define
+struct ShaderPermutation {
+    bool hasTexture = false;
+    bool textureArray = false; // the texture is a layer of a TextureArray, only with hasTexture
+    bool quantized = false; // the model uses a quantized VertexLayout
+    int numLights = 1;
+
+    uint32_t key() const {
+        return static_cast<uint32_t>(hasTexture) | static_cast<uint32_t>(textureArray) << 1 |
+               static_cast<uint32_t>(quantized) << 2 | static_cast<uint32_t>(numLights) << 3;
+    }
+    std::string defines() const {
+        std::string result;
+        if (hasTexture)
+            result += "#define HAS_TEXTURE\n";
+        if (hasTexture && textureArray)
+            result += "#define TEXTURE_ARRAY\n";
+        if (quantized)
+            result += "#define QUANTIZED\n";
+        result += "#define NUM_LIGHTS " + std::to_string(numLights) + "\n";
+        result += "#define MAX_LIGHTS " + std::to_string(LightData::MAX_LIGHTS) + "\n";
+        return result;
+    }
+};
+// builds specialized permutations of one uber shader on demand and keeps them,
+// unused paths are compiled away instead of branching at runtime
+class ShaderLibrary {
+public:
+    // sets up the uniforms of a permutation that never change, runs once the program is ready
+    typedef std::function<void(Shader&, const ShaderPermutation&)> Setup;
+
+    ShaderLibrary(std::string vertexPath, std::string fragmentPath, Setup setup = nullptr):
+            vertexPath(std::move(vertexPath)), fragmentPath(std::move(fragmentPath)), setup(std::move(setup)) {}
+
+    // the program is only submitted here, it is waited on when first used
+    Shader* get(const ShaderPermutation& permutation) {
+        auto it = programs.find(permutation.key());
+        if (it != programs.end())
+            return it->second.get();
+        Shader* shader = new Shader(vertexPath.c_str(), fragmentPath.c_str(), nullptr, permutation.defines());
+        if (setup)
+            shader->onFinalize = [this, permutation](Shader& program) { setup(program, permutation); };
+        programs[permutation.key()].reset(shader);
+        return shader;
+    }
+
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    Setup setup;
+    std::unordered_map<uint32_t, std::unique_ptr<Shader>> programs;
+};
 class Camera {
 public:
     enum Movement {
@@ -238,169 +779,3606 @@ public:
             zoom = 45.0f;
     }
 
-private:
-    // calculates the front vector from the Camera's (updated) Euler Angles
-    void updateCameraVectors() {
-        // calculate the new front vector
-        glm::vec3 _front;
-        _front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
-        _front.y = sin(glm::radians(pitch));
-        _front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
-        front = glm::normalize(_front);
+private:
+    // calculates the front vector from the Camera's (updated) Euler Angles
+    void updateCameraVectors() {
+        // calculate the new front vector
+        glm::vec3 _front;
+        _front.x = cos(glm::radians(yaw)) * cos(glm::radians(pitch));
+        _front.y = sin(glm::radians(pitch));
+        _front.z = sin(glm::radians(yaw)) * cos(glm::radians(pitch));
+        front = glm::normalize(_front);
+
+        // also re-calculate the right and up vector
+
+        // normalize the vectors, because their length gets closer to 0 the more you look up or down
+        // which results in slower movement.
+        right = glm::normalize(glm::cross(front, worldUp));
+        up = glm::normalize(glm::cross(right, front));
+    }
+};
+// read-only view of a whole file. files from MAP_THRESHOLD bytes up are memory mapped, so parsers
+// read the page cache directly, smaller ones are read into a buffer where a mapping costs more than it saves
+class MappedFile {
+public:
+    static const size_t MAP_THRESHOLD = 64 << 10;
+
+    explicit MappedFile(const std::string& path) {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return;
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(file, &fileSize) && static_cast<size_t>(fileSize.QuadPart) >= MAP_THRESHOLD) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                // the view keeps the mapping alive
+                CloseHandle(mapping);
+            }
+            if (view) {
+                bytes = static_cast<const unsigned char*>(view);
+                length = static_cast<size_t>(fileSize.QuadPart);
+                loaded = true;
+            }
+        }
+        CloseHandle(file);
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return;
+        struct stat fileStat{};
+        if (fstat(file, &fileStat) == 0 && static_cast<size_t>(fileStat.st_size) >= MAP_THRESHOLD) {
+            void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+            if (mapping != MAP_FAILED) {
+                madvise(mapping, static_cast<size_t>(fileStat.st_size), MADV_SEQUENTIAL);
+                view = mapping;
+                bytes = static_cast<const unsigned char*>(view);
+                length = static_cast<size_t>(fileStat.st_size);
+                loaded = true;
+            }
+        }
+        // the mapping stays valid after the descriptor is closed
+        close(file);
+#endif
+        if (!loaded)
+            readAll(path);
+    }
+    ~MappedFile() {
+        if (!view)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(view);
+#else
+        munmap(view, length);
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool valid() const {
+        return loaded;
+    }
+    bool mapped() const {
+        return view != nullptr;
+    }
+    const unsigned char* data() const {
+        return bytes;
+    }
+    size_t size() const {
+        return length;
+    }
+
+    // drop the file from the OS page cache so the next read comes from disk, for cold load benchmarks.
+    // false where that is not possible without privileges
+    static bool evictFromCache(const std::string& path) {
+#if defined(_WIN32) || defined(__APPLE__)
+        return false;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+            return false;
+        bool evicted = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+        close(file);
+        return evicted;
+#endif
+    }
+
+private:
+    void* view = nullptr;
+    const unsigned char* bytes = nullptr;
+    size_t length = 0;
+    bool loaded = false;
+    std::vector<unsigned char> buffer;
+
+    void readAll(const std::string& path) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return;
+        buffer.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size())))
+            return;
+        bytes = buffer.data();
+        length = buffer.size();
+        loaded = true;
+    }
+};
+// persistently mapped pixel unpack buffer used as a ring, image data is written straight into it
+// and glTex(Sub)Image reads from it asynchronously while the CPU moves on
+class PixelUploadBuffer {
+public:
+    static const size_t CAPACITY = 16 << 20;
+
+    // never destroyed, GL objects must not be released after the context is gone
+    static PixelUploadBuffer& get() {
+        static PixelUploadBuffer* buffer = new PixelUploadBuffer();
+        return *buffer;
+    }
+    ~PixelUploadBuffer() {
+        for (auto& region : regions)
+            glDeleteSync(region.fence);
+        glDeleteBuffers(1, &pbo);
+    }
+
+    // reserve size bytes and return where to write them, nullptr if the request can never fit
+    // offset is what glTex(Sub)Image gets as its pixel pointer while the buffer is bound
+    unsigned char* map(size_t size, size_t& offset) {
+        if (size > CAPACITY)
+            return nullptr;
+        if (head + size > CAPACITY)
+            head = 0;
+        // wait for uploads that still read from the range we are about to overwrite. after a wrap the
+        // oldest region may lie past it while newer ones do not, fences signal in order, so waiting
+        // for the newest overlapping region retires every region before it
+        while (overlaps(head, head + size)) {
+            glClientWaitSync(regions.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(regions.front().fence);
+            regions.pop_front();
+        }
+        offset = head;
+        current = {head, head + size, nullptr};
+        head += (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        if (persistent)
+            return mapped + offset;
+        return static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, size,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT));
+    }
+    // make the data written since map() visible to the following uploads and bind the buffer
+    void bind() {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        if (!persistent)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    // fence the uploads issued since bind() and unbind, so other code reads from client memory again
+    void unbind() {
+        current.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        regions.push_back(current);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+private:
+    static const size_t ALIGNMENT = 64;
+
+    struct Region {
+        size_t begin;
+        size_t end;
+        GLsync fence;
+    };
+
+    GLuint pbo = 0;
+    bool persistent = false;
+    unsigned char* mapped = nullptr;
+    size_t head = 0;
+    Region current{};
+    std::deque<Region> regions;
+
+    bool overlaps(size_t begin, size_t end) const {
+        for (const Region& region : regions) {
+            if (region.begin < end && begin < region.end)
+                return true;
+        }
+        return false;
+    }
+
+    PixelUploadBuffer() {
+        glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        persistent = GLEW_ARB_buffer_storage != 0;
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, CAPACITY, nullptr, flags);
+            mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, CAPACITY, flags));
+        } else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, CAPACITY, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+};
+// shared sampler object, filtering state lives here instead of in every texture
+class Sampler {
+public:
+    struct Parameters {
+        GLenum minFilter = GL_LINEAR_MIPMAP_LINEAR;
+        GLenum magFilter = GL_LINEAR;
+        GLenum wrap = GL_CLAMP_TO_EDGE;
+        float anisotropy = 8.0f; // clamped to what the driver supports, 1 disables it
+
+        bool operator==(const Parameters& other) const {
+            return minFilter == other.minFilter && magFilter == other.magFilter &&
+                   wrap == other.wrap && anisotropy == other.anisotropy;
+        }
+    };
+
+    GLuint sampler = 0;
+    const Parameters parameters;
+
+    // samplers with equal parameters are created once and shared
+    static Sampler* get() {
+        return get(Parameters());
+    }
+    static Sampler* get(const Parameters& parameters) {
+        // never destroyed, see PixelUploadBuffer::get
+        static std::vector<Sampler*>* samplers = new std::vector<Sampler*>();
+        for (Sampler* existing : *samplers) {
+            if (existing->parameters == parameters)
+                return existing;
+        }
+        samplers->push_back(new Sampler(parameters));
+        return samplers->back();
+    }
+    // highest anisotropy the driver supports, 1 without anisotropic filtering
+    static float maxAnisotropy() {
+        static float maximum = -1.0f;
+        if (maximum < 0.0f) {
+            maximum = 1.0f;
+            if (GLEW_ARB_texture_filter_anisotropic || GLEW_EXT_texture_filter_anisotropic)
+                glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY, &maximum);
+        }
+        return maximum;
+    }
+    ~Sampler() {
+        glDeleteSamplers(1, &sampler);
+    }
+
+    void bind(unsigned int slot) const {
+        RenderState::get().bindSampler(slot, sampler);
+    }
+
+private:
+    explicit Sampler(const Parameters& parameters): parameters(parameters) {
+        glGenSamplers(1, &sampler);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, parameters.wrap);
+        glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, parameters.wrap);
+        glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, parameters.minFilter);
+        glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, parameters.magFilter);
+        float anisotropy = std::min(parameters.anisotropy, maxAnisotropy());
+        if (anisotropy > 1.0f)
+            glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY, anisotropy);
+    }
+};
+// CPU kernels for preparing texture images. the kernels have a scalar version and SSSE3 and AVX2
+// versions picked at runtime from what the processor supports, all of them produce the same bytes.
+// the vector versions return how many pixels they handled and the scalar one finishes the rest
+class ImageKernels {
+public:
+    enum Level { SCALAR, SSSE3, AVX2 };
+
+    // best level the processor and the OS run
+    static Level supported() {
+        static const Level detected = detect();
+        return detected;
+    }
+    // level the kernels dispatch to, lowered by the benchmark to compare the versions
+    static Level& active() {
+        static Level level = supported();
+        return level;
+    }
+    static const char* name(Level level) {
+        switch (level) {
+        case AVX2:
+            return "AVX2";
+        case SSSE3:
+            return "SSSE3";
+        default:
+            return "scalar";
+        }
+    }
+
+    // images from this size up are written around the caches by flipRows, smaller ones are
+    // faster to copy through them
+    static const size_t STREAM_THRESHOLD = 8 << 20;
+
+    // copy height rows of rowSize bytes into dst in reverse order. dst usually is pixel buffer memory
+    // read by the driver, the vector versions fill it with non-temporal stores past STREAM_THRESHOLD
+    static void flipRows(const unsigned char* src, unsigned char* dst, size_t rowSize, int height) {
+#ifdef IMAGE_KERNELS_X86
+        if (active() == AVX2 && rowSize * height >= STREAM_THRESHOLD)
+            return flipRowsAVX2(src, dst, rowSize, height);
+        if (active() == SSSE3 && rowSize * height >= STREAM_THRESHOLD)
+            return flipRowsSSSE3(src, dst, rowSize, height);
+#endif
+        for (int y = 0; y < height; ++y)
+            memcpy(dst + y * rowSize, src + (height - 1 - y) * rowSize, rowSize);
+    }
+
+    // convert count pixels between layouts of 1 to 4 channels. one and two channel images are gray and
+    // gray with alpha, as Texture::Format samples them: expanding replicates gray into rgb and makes
+    // missing alpha opaque, contracting keeps red and, for two channels, alpha
+    static void convertChannels(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels, size_t count) {
+        if (srcChannels == dstChannels) {
+            memcpy(dst, src, count * dstChannels);
+            return;
+        }
+        size_t done = 0;
+#ifdef IMAGE_KERNELS_X86
+        if (active() == AVX2)
+            done = convertChannelsAVX2(src, srcChannels, dst, dstChannels, count);
+        else if (active() == SSSE3)
+            done = convertChannelsSSSE3(src, srcChannels, dst, dstChannels, count);
+#endif
+        src += done * srcChannels;
+        dst += done * dstChannels;
+        for (size_t i = done; i < count; ++i, src += srcChannels, dst += dstChannels) {
+            const unsigned char alpha = srcChannels == 2 ? src[1] : srcChannels == 4 ? src[3] : 255;
+            if (dstChannels <= 2) {
+                dst[0] = src[0];
+                if (dstChannels == 2)
+                    dst[1] = alpha;
+                continue;
+            }
+            for (int c = 0; c < 3; ++c)
+                dst[c] = srcChannels >= 3 ? src[c] : src[0];
+            if (dstChannels == 4)
+                dst[3] = alpha;
+        }
+    }
+
+    // 2x2 box filter of a width x height image into a max(width / 2, 1) x max(height / 2, 1) one,
+    // an odd last row or column is dropped and a single one is reused. with srgb the color channels
+    // of 3 and 4 channel images are averaged as linear light and rounded in sRGB, alpha never is
+    static void downsample(const unsigned char* src, int width, int height, int channels, bool srgb, unsigned char* dst) {
+        const int dstWidth = std::max(width / 2, 1);
+        const int dstHeight = std::max(height / 2, 1);
+        const size_t srcRowSize = static_cast<size_t>(width) * channels;
+        const size_t dstRowSize = static_cast<size_t>(dstWidth) * channels;
+        srgb = srgb && channels >= 3;
+        for (int y = 0; y < dstHeight; ++y) {
+            const unsigned char* row0 = src + std::min(y * 2, height - 1) * srcRowSize;
+            const unsigned char* row1 = src + std::min(y * 2 + 1, height - 1) * srcRowSize;
+            unsigned char* out = dst + y * dstRowSize;
+            int done = 0;
+#ifdef IMAGE_KERNELS_X86
+            // the sRGB path is bound by its table lookups, which gathers do not speed up
+            if (width >= 2 && !srgb && active() == AVX2)
+                done = downsampleRowAVX2(row0, row1, width, dstWidth, channels, out);
+            else if (width >= 2 && !srgb && active() == SSSE3)
+                done = downsampleRowSSSE3(row0, row1, width, dstWidth, channels, out);
+#endif
+            const SrgbTables& tables = srgbTables();
+            for (int x = done; x < dstWidth; ++x) {
+                const size_t left = static_cast<size_t>(std::min(x * 2, width - 1)) * channels;
+                const size_t right = static_cast<size_t>(std::min(x * 2 + 1, width - 1)) * channels;
+                for (int c = 0; c < channels; ++c) {
+                    const unsigned char a = row0[left + c], b = row0[right + c], d = row1[left + c], e = row1[right + c];
+                    if (srgb && c < 3) {
+                        float sum = tables.toLinear[a] + tables.toLinear[b] + tables.toLinear[d] + tables.toLinear[e];
+                        out[x * channels + c] = tables.encode(sum * 0.25f);
+                    } else {
+                        out[x * channels + c] = static_cast<unsigned char>((a + b + d + e + 2) / 4);
+                    }
+                }
+            }
+        }
+    }
+
+    // multiply the color of count rgba pixels by their alpha, rounded to nearest. the stored values
+    // are scaled as they are, sRGB images have to be decoded first for the result to be linear
+    static void premultiplyAlpha(unsigned char* pixels, size_t count) {
+        size_t done = 0;
+#ifdef IMAGE_KERNELS_X86
+        if (active() == AVX2)
+            done = premultiplyAlphaAVX2(pixels, count);
+        else if (active() == SSSE3)
+            done = premultiplyAlphaSSSE3(pixels, count);
+#endif
+        for (size_t i = done; i < count; ++i) {
+            unsigned char* pixel = pixels + i * 4;
+            for (int c = 0; c < 3; ++c) {
+                // exact round(color * alpha / 255) for 8-bit values, without a division
+                unsigned t = pixel[c] * pixel[3] + 128u;
+                pixel[c] = static_cast<unsigned char>((t + (t >> 8)) >> 8);
+            }
+        }
+    }
+
+private:
+    // sRGB decoding table and the linear values halfway between consecutive sRGB codes,
+    // a value encodes to the number of thresholds at or below it. the count is looked up for
+    // the value rounded down to 1/BUCKETS, the steepest part of the curve puts less than one
+    // threshold into a bucket, so one comparison finishes it
+    struct SrgbTables {
+        static const int BUCKETS = 4096;
+
+        float toLinear[256];
+        float thresholds[256]; // the last one is past any linear value
+        int32_t buckets[BUCKETS + 1];
+
+        SrgbTables() {
+            for (int i = 0; i < 256; ++i) {
+                toLinear[i] = static_cast<float>(decode(i / 255.0));
+                thresholds[i] = i < 255 ? static_cast<float>(decode((i + 0.5) / 255.0)) : 2.0f;
+            }
+            for (int i = 0, code = 0; i <= BUCKETS; ++i) {
+                while (thresholds[code] <= static_cast<float>(i) / BUCKETS)
+                    ++code;
+                buckets[i] = code;
+            }
+        }
+        static double decode(double value) {
+            return value <= 0.04045 ? value / 12.92 : std::pow((value + 0.055) / 1.055, 2.4);
+        }
+        // linear in [0, 1]
+        unsigned char encode(float linear) const {
+            int code = buckets[static_cast<int>(linear * BUCKETS)];
+            return static_cast<unsigned char>(code + (thresholds[code] <= linear ? 1 : 0));
+        }
+    };
+    static const SrgbTables& srgbTables() {
+        static const SrgbTables tables;
+        return tables;
+    }
+
+    static Level detect() {
+#ifdef IMAGE_KERNELS_X86
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        const int maxLeaf = info[0];
+        __cpuid(info, 1);
+        const bool ssse3 = (info[2] >> 9 & 1) != 0;
+        // AVX registers also have to be saved by the OS
+        const bool avx = (info[2] >> 27 & 1) && (info[2] >> 28 & 1) && (_xgetbv(0) & 6) == 6;
+        bool avx2 = false;
+        if (maxLeaf >= 7) {
+            __cpuidex(info, 7, 0);
+            avx2 = avx && (info[1] >> 5 & 1);
+        }
+        return avx2 ? AVX2 : ssse3 ? SSSE3 : SCALAR;
+#else
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return AVX2;
+        if (__builtin_cpu_supports("ssse3"))
+            return SSSE3;
+#endif
+#endif
+        return SCALAR;
+    }
+
+#ifdef IMAGE_KERNELS_X86
+    KERNEL_TARGET("ssse3")
+    static void flipRowsSSSE3(const unsigned char* src, unsigned char* dst, size_t rowSize, int height) {
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* from = src + (height - 1 - y) * rowSize;
+            unsigned char* to = dst + y * rowSize;
+            // streaming stores need aligned destinations, the unaligned ends are copied
+            size_t x = std::min<size_t>((16 - reinterpret_cast<uintptr_t>(to) % 16) % 16, rowSize);
+            memcpy(to, from, x);
+            for (; x + 16 <= rowSize; x += 16)
+                _mm_stream_si128(reinterpret_cast<__m128i*>(to + x), _mm_loadu_si128(reinterpret_cast<const __m128i*>(from + x)));
+            memcpy(to + x, from + x, rowSize - x);
+        }
+        _mm_sfence();
+    }
+    KERNEL_TARGET("avx2")
+    static void flipRowsAVX2(const unsigned char* src, unsigned char* dst, size_t rowSize, int height) {
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* from = src + (height - 1 - y) * rowSize;
+            unsigned char* to = dst + y * rowSize;
+            size_t x = std::min<size_t>((32 - reinterpret_cast<uintptr_t>(to) % 32) % 32, rowSize);
+            memcpy(to, from, x);
+            for (; x + 32 <= rowSize; x += 32)
+                _mm256_stream_si256(reinterpret_cast<__m256i*>(to + x), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(from + x)));
+            memcpy(to + x, from + x, rowSize - x);
+        }
+        _mm_sfence();
+    }
+
+    // rgb <-> rgba, gray -> rgba and gray alpha -> rgba through byte shuffles, other pairs are left to the scalar loop
+    KERNEL_TARGET("ssse3")
+    static size_t convertChannelsSSSE3(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels, size_t count) {
+        const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000u));
+        size_t i = 0;
+        if (srcChannels == 3 && dstChannels == 4) {
+            // 4 pixels per step, the 16 byte load reads 4 bytes past them
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            for (; i + 6 <= count; i += 4) {
+                __m128i rgb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(rgb, shuffle), opaque));
+            }
+        } else if (srcChannels == 4 && dstChannels == 3) {
+            // the 16 byte store writes 4 bytes past the pixels, the next step overwrites them
+            const __m128i shuffle = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            for (; i + 6 <= count; i += 4) {
+                __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm_shuffle_epi8(rgba, shuffle));
+            }
+        } else if (srcChannels == 1 && dstChannels == 4) {
+            const __m128i shuffle = _mm_setr_epi8(0, 0, 0, -1, 1, 1, 1, -1, 2, 2, 2, -1, 3, 3, 3, -1);
+            for (; i + 4 <= count; i += 4) {
+                int gray;
+                memcpy(&gray, src + i, sizeof(gray));
+                __m128i expanded = _mm_shuffle_epi8(_mm_cvtsi32_si128(gray), shuffle);
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_or_si128(expanded, opaque));
+            }
+        } else if (srcChannels == 2 && dstChannels == 4) {
+            const __m128i shuffle = _mm_setr_epi8(0, 0, 0, 1, 2, 2, 2, 3, 4, 4, 4, 5, 6, 6, 6, 7);
+            for (; i + 4 <= count; i += 4) {
+                __m128i grayAlpha = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i * 2));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(grayAlpha, shuffle));
+            }
+        }
+        return i;
+    }
+    // rgb <-> rgba 8 pixels per step, the shuffles work within 128-bit lanes so each lane takes 4 pixels
+    KERNEL_TARGET("avx2")
+    static size_t convertChannelsAVX2(const unsigned char* src, int srcChannels, unsigned char* dst, int dstChannels, size_t count) {
+        size_t i = 0;
+        if (srcChannels == 3 && dstChannels == 4) {
+            const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+                                                     0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+            const __m256i opaque = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+            for (; i + 10 <= count; i += 8) {
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3));
+                __m128i high = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 3 + 12));
+                __m256i rgb = _mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1);
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(rgb, shuffle), opaque));
+            }
+        } else if (srcChannels == 4 && dstChannels == 3) {
+            const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                                     0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            for (; i + 10 <= count; i += 8) {
+                __m256i rgb = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4)), shuffle);
+                // the high lane overwrites the 4 spare bytes of the low one
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3), _mm256_castsi256_si128(rgb));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 3 + 12), _mm256_extracti128_si256(rgb, 1));
+            }
+        }
+        return i + convertChannelsSSSE3(src + i * srcChannels, srcChannels, dst + i * dstChannels, dstChannels, count - i);
+    }
+
+    // sums of horizontally adjacent pixels of 16-bit column sums, 4 values in the low 64 bits
+    KERNEL_TARGET("ssse3")
+    static __m128i pairSums(__m128i sums, int channels) {
+        if (channels == 1)
+            return _mm_packs_epi32(_mm_madd_epi16(sums, _mm_set1_epi16(1)), _mm_setzero_si128());
+        if (channels == 2)
+            return _mm_add_epi16(_mm_shuffle_epi32(sums, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_epi32(sums, _MM_SHUFFLE(3, 1, 3, 1)));
+        return _mm_add_epi16(sums, _mm_srli_si128(sums, 8));
+    }
+    // 1, 2 and 4 channels, 16 output bytes from 32 bytes of both source rows per step
+    KERNEL_TARGET("ssse3")
+    static int downsampleRowSSSE3(const unsigned char* row0, const unsigned char* row1, int width, int dstWidth, int channels, unsigned char* out) {
+        if (channels == 3)
+            return 0;
+        const size_t srcBytes = static_cast<size_t>(width) * channels, dstBytes = static_cast<size_t>(dstWidth) * channels;
+        const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+        size_t j = 0;
+        for (; j + 16 <= dstBytes && j * 2 + 32 <= srcBytes; j += 16) {
+            __m128i pairs[4];
+            for (int k = 0; k < 2; ++k) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + j * 2 + k * 16));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + j * 2 + k * 16));
+                pairs[k * 2] = pairSums(_mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)), channels);
+                pairs[k * 2 + 1] = pairSums(_mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)), channels);
+            }
+            __m128i low = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(pairs[0], pairs[1]), two), 2);
+            __m128i high = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(pairs[2], pairs[3]), two), 2);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + j), _mm_packus_epi16(low, high));
+        }
+        return static_cast<int>(j / channels);
+    }
+    KERNEL_TARGET("avx2")
+    static __m256i pairSums(__m256i sums, int channels) {
+        if (channels == 1)
+            return _mm256_packs_epi32(_mm256_madd_epi16(sums, _mm256_set1_epi16(1)), _mm256_setzero_si256());
+        if (channels == 2)
+            return _mm256_add_epi16(_mm256_shuffle_epi32(sums, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_epi32(sums, _MM_SHUFFLE(3, 1, 3, 1)));
+        return _mm256_add_epi16(sums, _mm256_srli_si256(sums, 8));
+    }
+    // 1, 2 and 4 channels, 32 output bytes from 64 bytes of both source rows per step. the pair sums
+    // stay within 128-bit lanes, the 64-bit permutes put them back in order
+    KERNEL_TARGET("avx2")
+    static int downsampleRowAVX2(const unsigned char* row0, const unsigned char* row1, int width, int dstWidth, int channels, unsigned char* out) {
+        if (channels == 3)
+            return 0;
+        const size_t srcBytes = static_cast<size_t>(width) * channels, dstBytes = static_cast<size_t>(dstWidth) * channels;
+        const __m256i two = _mm256_set1_epi16(2);
+        size_t j = 0;
+        for (; j + 32 <= dstBytes && j * 2 + 64 <= srcBytes; j += 32) {
+            __m256i pairs[4];
+            for (int k = 0; k < 4; ++k) {
+                __m256i a = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + j * 2 + k * 16)));
+                __m256i b = _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + j * 2 + k * 16)));
+                pairs[k] = pairSums(_mm256_add_epi16(a, b), channels);
+            }
+            __m256i low = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(pairs[0], pairs[1]), _MM_SHUFFLE(3, 1, 2, 0));
+            __m256i high = _mm256_permute4x64_epi64(_mm256_unpacklo_epi64(pairs[2], pairs[3]), _MM_SHUFFLE(3, 1, 2, 0));
+            low = _mm256_srli_epi16(_mm256_add_epi16(low, two), 2);
+            high = _mm256_srli_epi16(_mm256_add_epi16(high, two), 2);
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j), packed);
+        }
+        return static_cast<int>(j / channels);
+    }
+    // 4 pixels per step, each alpha is spread over its pixel with 255 in the alpha lane itself
+    KERNEL_TARGET("ssse3")
+    static size_t premultiplyAlphaSSSE3(unsigned char* pixels, size_t count) {
+        const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+        const __m128i colorMask = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+        const __m128i alphaOne = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i rgba = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + i * 4));
+            __m128i halves[2] = {_mm_unpacklo_epi8(rgba, zero), _mm_unpackhi_epi8(rgba, zero)};
+            for (__m128i& pixel : halves) {
+                __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(pixel, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                __m128i t = _mm_add_epi16(_mm_mullo_epi16(pixel, _mm_or_si128(_mm_and_si128(alpha, colorMask), alphaOne)), half);
+                pixel = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + i * 4), _mm_packus_epi16(halves[0], halves[1]));
+        }
+        return i;
+    }
+    KERNEL_TARGET("avx2")
+    static size_t premultiplyAlphaAVX2(unsigned char* pixels, size_t count) {
+        const __m256i zero = _mm256_setzero_si256(), half = _mm256_set1_epi16(128);
+        const __m256i colorMask = _mm256_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0, -1, -1, -1, 0);
+        const __m256i alphaOne = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i rgba = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + i * 4));
+            __m256i halves[2] = {_mm256_unpacklo_epi8(rgba, zero), _mm256_unpackhi_epi8(rgba, zero)};
+            for (__m256i& pixel : halves) {
+                __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(pixel, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+                __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(pixel, _mm256_or_si256(_mm256_and_si256(alpha, colorMask), alphaOne)), half);
+                pixel = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+            }
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + i * 4), _mm256_packus_epi16(halves[0], halves[1]));
+        }
+        return i;
+    }
+#endif
+};
+// CPU encoder for the BCn block formats, used to build the compressed texture cache
+// runs without a GL context, blocks are 4x4 texels given as RGBA8
+class BlockCompressor {
+public:
+    // 8 bytes per block, opaque rgb
+    static void encodeBC1(const unsigned char rgba[64], unsigned char* out) {
+        // endpoints along the principal axis of the block colors
+        float mean[3], axis[3];
+        principalAxis(rgba, 3, mean, axis);
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        int minIndex = 0, maxIndex = 0;
+        for (int i = 0; i < 16; ++i) {
+            float projection = 0.0f;
+            for (int c = 0; c < 3; ++c)
+                projection += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            if (projection < minProjection) {
+                minProjection = projection;
+                minIndex = i;
+            }
+            if (projection > maxProjection) {
+                maxProjection = projection;
+                maxIndex = i;
+            }
+        }
+        uint16_t color0 = pack565(rgba + maxIndex * 4);
+        uint16_t color1 = pack565(rgba + minIndex * 4);
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            // color0 > color1 selects the four color mode
+            if (color0 < color1)
+                std::swap(color0, color1);
+            int palette[4][3];
+            unpack565(color0, palette[0]);
+            unpack565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0, bestError = INT32_MAX;
+                for (int p = 0; p < 4; ++p) {
+                    int error = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = rgba[i * 4 + c] - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= static_cast<uint32_t>(best) << (2 * i);
+            }
+        }
+        out[0] = color0 & 0xff;
+        out[1] = color0 >> 8;
+        out[2] = color1 & 0xff;
+        out[3] = color1 >> 8;
+        for (int i = 0; i < 4; ++i)
+            out[4 + i] = (indices >> (8 * i)) & 0xff;
+    }
+    // 8 bytes per block, one channel taken from rgba[channel]
+    static void encodeBC4(const unsigned char rgba[64], int channel, unsigned char* out) {
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; ++i) {
+            lo = std::min<int>(lo, rgba[i * 4 + channel]);
+            hi = std::max<int>(hi, rgba[i * 4 + channel]);
+        }
+        out[0] = static_cast<unsigned char>(hi);
+        out[1] = static_cast<unsigned char>(lo);
+        uint64_t indices = 0;
+        if (hi > lo) {
+            // red0 > red1 selects the eight value mode, index 0 and 1 are the endpoints
+            int palette[8];
+            palette[0] = hi;
+            palette[1] = lo;
+            for (int p = 1; p < 7; ++p)
+                palette[p + 1] = ((7 - p) * hi + p * lo + 3) / 7;
+            for (int i = 0; i < 16; ++i) {
+                int value = rgba[i * 4 + channel];
+                int best = 0, bestError = INT32_MAX;
+                for (int p = 0; p < 8; ++p) {
+                    int error = std::abs(value - palette[p]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= static_cast<uint64_t>(best) << (3 * i);
+            }
+        }
+        for (int i = 0; i < 6; ++i)
+            out[2 + i] = (indices >> (8 * i)) & 0xff;
+    }
+    // 16 bytes per block, gray and alpha of a two channel image expanded to rgba as two BC4 blocks
+    static void encodeBC5(const unsigned char rgba[64], unsigned char* out) {
+        encodeBC4(rgba, 0, out);
+        encodeBC4(rgba, 3, out + 8);
+    }
+    // 16 bytes per block, rgba in BC7 mode 6: one subset, 7 bit endpoints with a p-bit each, 4 bit indices
+    static void encodeBC7(const unsigned char rgba[64], unsigned char* out) {
+        static const int WEIGHTS[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+        float mean[4], axis[4];
+        principalAxis(rgba, 4, mean, axis);
+        float minProjection = 1e30f, maxProjection = -1e30f;
+        for (int i = 0; i < 16; ++i) {
+            float projection = 0.0f;
+            for (int c = 0; c < 4; ++c)
+                projection += (rgba[i * 4 + c] - mean[c]) * axis[c];
+            minProjection = std::min(minProjection, projection);
+            maxProjection = std::max(maxProjection, projection);
+        }
+        // endpoints are the extremes of the block projected onto the axis
+        int endpoints[2][4];
+        int pbits[2];
+        for (int e = 0; e < 2; ++e) {
+            float projection = e == 0 ? minProjection : maxProjection;
+            int best = INT32_MAX;
+            for (int p = 0; p < 2; ++p) {
+                int quantized[4], error = 0;
+                for (int c = 0; c < 4; ++c) {
+                    float value = std::min(std::max(mean[c] + axis[c] * projection, 0.0f), 255.0f);
+                    int q = std::min(std::max(static_cast<int>(std::lround((value - p) / 2.0f)), 0), 127);
+                    quantized[c] = q;
+                    error += std::abs(((q << 1) | p) - static_cast<int>(std::lround(value)));
+                }
+                if (error < best) {
+                    best = error;
+                    pbits[e] = p;
+                    std::copy(quantized, quantized + 4, endpoints[e]);
+                }
+            }
+        }
+        int palette[16][4];
+        for (int w = 0; w < 16; ++w) {
+            for (int c = 0; c < 4; ++c) {
+                int e0 = (endpoints[0][c] << 1) | pbits[0];
+                int e1 = (endpoints[1][c] << 1) | pbits[1];
+                palette[w][c] = ((64 - WEIGHTS[w]) * e0 + WEIGHTS[w] * e1 + 32) >> 6;
+            }
+        }
+        int indices[16];
+        for (int i = 0; i < 16; ++i) {
+            int best = 0, bestError = INT32_MAX;
+            for (int w = 0; w < 16; ++w) {
+                int error = 0;
+                for (int c = 0; c < 4; ++c) {
+                    int d = rgba[i * 4 + c] - palette[w][c];
+                    error += d * d;
+                }
+                if (error < bestError) {
+                    bestError = error;
+                    best = w;
+                }
+            }
+            indices[i] = best;
+        }
+        // the most significant index bit of texel 0 is implied zero, swap the endpoints if it is set
+        if (indices[0] >= 8) {
+            for (int c = 0; c < 4; ++c)
+                std::swap(endpoints[0][c], endpoints[1][c]);
+            std::swap(pbits[0], pbits[1]);
+            for (int& index : indices)
+                index = 15 - index;
+        }
+        BitWriter bits(out);
+        bits.write(1 << 6, 7); // mode 6
+        for (int c = 0; c < 4; ++c) {
+            bits.write(endpoints[0][c], 7);
+            bits.write(endpoints[1][c], 7);
+        }
+        bits.write(pbits[0], 1);
+        bits.write(pbits[1], 1);
+        bits.write(indices[0], 3);
+        for (int i = 1; i < 16; ++i)
+            bits.write(indices[i], 4);
+    }
+
+    // bytes of one block of an image with the given channel count: BC4 for 1, BC5 for 2, BC1 for 3 and BC7 for 4
+    static int blockBytes(int channels) {
+        return channels == 1 || channels == 3 ? 8 : 16;
+    }
+    static size_t imageSize(int width, int height, int channels) {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(channels);
+    }
+    // encode an 8-bit image whose rows are stored top to bottom, the blocks are written bottom row first
+    // so they can be uploaded as is. texels past the right and top edges repeat the last ones
+    static void compress(const unsigned char* pixels, int width, int height, int channels, unsigned char* out) {
+        unsigned char block[64];
+        std::vector<unsigned char> strip(static_cast<size_t>(width) * 4 * 4);
+        for (int by = 0; by < height; by += 4) {
+            // the 4 rows of this row of blocks expanded to rgba
+            for (int row = 0; row < 4; ++row) {
+                int y = height - 1 - std::min(by + row, height - 1);
+                ImageKernels::convertChannels(pixels + static_cast<size_t>(y) * width * channels, channels,
+                                              strip.data() + static_cast<size_t>(row) * width * 4, 4, width);
+            }
+            for (int bx = 0; bx < width; bx += 4) {
+                for (int i = 0; i < 16; ++i) {
+                    int x = std::min(bx + i % 4, width - 1);
+                    memcpy(block + i * 4, strip.data() + (static_cast<size_t>(i / 4) * width + x) * 4, 4);
+                }
+                switch (channels) {
+                case 1:
+                    encodeBC4(block, 0, out);
+                    break;
+                case 2:
+                    encodeBC5(block, out);
+                    break;
+                case 3:
+                    encodeBC1(block, out);
+                    break;
+                default:
+                    encodeBC7(block, out);
+                }
+                out += blockBytes(channels);
+            }
+        }
+    }
+
+private:
+    // writes little endian bit fields into a 16 byte block
+    struct BitWriter {
+        explicit BitWriter(unsigned char* out): out(out) {
+            std::fill(out, out + 16, 0);
+        }
+        void write(uint32_t value, int count) {
+            for (int i = 0; i < count; ++i, ++position) {
+                if (value >> i & 1)
+                    out[position / 8] |= static_cast<unsigned char>(1 << (position % 8));
+            }
+        }
+        unsigned char* out;
+        int position = 0;
+    };
+
+    static uint16_t pack565(const unsigned char* rgb) {
+        return static_cast<uint16_t>((rgb[0] * 31 + 127) / 255 << 11 | (rgb[1] * 63 + 127) / 255 << 5 | (rgb[2] * 31 + 127) / 255);
+    }
+    static void unpack565(uint16_t color, int* rgb) {
+        int r = color >> 11 & 31, g = color >> 5 & 63, b = color & 31;
+        rgb[0] = r << 3 | r >> 2;
+        rgb[1] = g << 2 | g >> 4;
+        rgb[2] = b << 3 | b >> 2;
+    }
+    // mean and dominant direction of the block colors, found by power iteration on the covariance
+    static void principalAxis(const unsigned char rgba[64], int channels, float* mean, float* axis) {
+        for (int c = 0; c < channels; ++c) {
+            mean[c] = 0.0f;
+            for (int i = 0; i < 16; ++i)
+                mean[c] += rgba[i * 4 + c];
+            mean[c] /= 16.0f;
+        }
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; ++i) {
+            for (int a = 0; a < channels; ++a) {
+                for (int b = 0; b < channels; ++b)
+                    covariance[a][b] += (rgba[i * 4 + a] - mean[a]) * (rgba[i * 4 + b] - mean[b]);
+            }
+        }
+        for (int c = 0; c < channels; ++c)
+            axis[c] = 1.0f;
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[4] = {}, length = 0.0f;
+            for (int a = 0; a < channels; ++a) {
+                for (int b = 0; b < channels; ++b)
+                    next[a] += covariance[a][b] * axis[b];
+                length += next[a] * next[a];
+            }
+            if (length < 1e-12f)
+                break;
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; ++c)
+                axis[c] = next[c] / length;
+        }
+    }
+};
+// GL_TEXTURE_2D_ARRAY whose layers are handed out to textures of one format and size class,
+// so every texture in it is covered by a single binding. layers are allocated by TexturePacker
+class TextureArray {
+public:
+    GLuint texture = 0;
+    GLenum internalFormat;
+    GLint swizzle[4];
+    Sampler* sampler;
+    int width;
+    int height;
+    int mipLevels;
+    int capacity = 0; // allocated layers
+    size_t memorySize = 0; // bytes of all allocated layers on the GPU
+
+    TextureArray(GLenum internalFormat, const GLint* swizzle, int width, int height, Sampler* sampler, size_t layerSize):
+            internalFormat(internalFormat), sampler(sampler), width(width), height(height), layerSize(layerSize) {
+        std::copy(swizzle, swizzle + 4, this->swizzle);
+        mipLevels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+    }
+    ~TextureArray() {
+        glDeleteTextures(1, &texture);
+        RenderState::get().forgetTexture(texture);
+    }
+
+    // a free layer, -1 if all allocated layers are taken
+    int acquire() {
+        if (!freeLayers.empty()) {
+            int layer = freeLayers.back();
+            freeLayers.pop_back();
+            return layer;
+        }
+        return used < capacity ? used++ : -1;
+    }
+    void release(int layer) {
+        freeLayers.push_back(layer);
+    }
+    // reallocate with room for more layers, the layers in use are copied on the GPU
+    void grow(int layers) {
+        GLuint grown = 0;
+        glGenTextures(1, &grown);
+        RenderState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, grown);
+        glTexStorage3D(GL_TEXTURE_2D_ARRAY, mipLevels, internalFormat, width, height, layers);
+        glTexParameteriv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+        if (used > 0) {
+            for (int level = 0; level < mipLevels; ++level) {
+                glCopyImageSubData(texture, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, grown, GL_TEXTURE_2D_ARRAY, level, 0, 0, 0,
+                                   std::max(width >> level, 1), std::max(height >> level, 1), used);
+            }
+        }
+        glDeleteTextures(1, &texture);
+        RenderState::get().forgetTexture(texture);
+        texture = grown;
+        capacity = layers;
+        memorySize = layerSize * layers;
+    }
+
+    void bind(unsigned int slot) const {
+        RenderState::get().bindTexture(slot, GL_TEXTURE_2D_ARRAY, texture);
+        sampler->bind(slot);
+    }
+
+private:
+    size_t layerSize;
+    int used = 0; // layers below this were handed out at least once
+    std::vector<int> freeLayers;
+};
+class Texture {
+public:
+    // image rows are stored top to bottom as decoded, they are mirrored while uploading.
+    // compressed levels hold BlockCompressor blocks that are already in OpenGL row order
+    struct TextureData {
+        TextureData(): width(0), height(0), channels(0), compressed(false) {}
+
+        int width;
+        int height;
+        int channels;
+        bool compressed;
+        std::shared_ptr<unsigned char> data;
+
+        size_t size() const {
+            if (compressed)
+                return BlockCompressor::imageSize(width, height, channels);
+            return static_cast<size_t>(width) * height * channels;
+        }
+    };
+
+    // GL format of an 8-bit image with the given number of channels
+    struct Format {
+        GLenum internalFormat;
+        GLenum format;
+        GLint swizzle[4]; // grayscale images are expanded to rgb by the sampler instead of in memory
+        const char* name;
+        bool compressed;
+
+        static Format forChannels(int channels, bool srgb) {
+            switch (channels) {
+            case 1:
+                return {GL_R8, GL_RED, {GL_RED, GL_RED, GL_RED, GL_ONE}, "GL_R8", false};
+            case 2:
+                return {GL_RG8, GL_RG, {GL_RED, GL_RED, GL_RED, GL_GREEN}, "GL_RG8", false};
+            case 3:
+                if (srgb)
+                    return {GL_SRGB8, GL_RGB, {GL_RED, GL_GREEN, GL_BLUE, GL_ONE}, "GL_SRGB8", false};
+                return {GL_RGB8, GL_RGB, {GL_RED, GL_GREEN, GL_BLUE, GL_ONE}, "GL_RGB8", false};
+            default:
+                if (srgb)
+                    return {GL_SRGB8_ALPHA8, GL_RGBA, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}, "GL_SRGB8_ALPHA8", false};
+                return {GL_RGBA8, GL_RGBA, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}, "GL_RGBA8", false};
+            }
+        }
+        // block-compressed format BlockCompressor produces for the given number of channels
+        static Format forCompressedChannels(int channels, bool srgb) {
+            switch (channels) {
+            case 1:
+                return {GL_COMPRESSED_RED_RGTC1, GL_RED, {GL_RED, GL_RED, GL_RED, GL_ONE}, "BC4", true};
+            case 2:
+                return {GL_COMPRESSED_RG_RGTC2, GL_RG, {GL_RED, GL_RED, GL_RED, GL_GREEN}, "BC5", true};
+            case 3:
+                if (srgb)
+                    return {GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, GL_RGB, {GL_RED, GL_GREEN, GL_BLUE, GL_ONE}, "BC1 sRGB", true};
+                return {GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_RGB, {GL_RED, GL_GREEN, GL_BLUE, GL_ONE}, "BC1", true};
+            default:
+                if (srgb)
+                    return {GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM, GL_RGBA, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}, "BC7 sRGB", true};
+                return {GL_COMPRESSED_RGBA_BPTC_UNORM, GL_RGBA, {GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA}, "BC7", true};
+            }
+        }
+        // whether the driver can sample forCompressedChannels(channels, srgb)
+        static bool compressionSupported(int channels, bool srgb) {
+            switch (channels) {
+            case 1:
+            case 2:
+                return GLEW_VERSION_3_0 || GLEW_ARB_texture_compression_rgtc;
+            case 3:
+                return GLEW_EXT_texture_compression_s3tc && (!srgb || GLEW_EXT_texture_sRGB);
+            default:
+                return GLEW_VERSION_4_2 || GLEW_ARB_texture_compression_bptc;
+            }
+        }
+    };
+
+    GLuint texture = 0;
+    Sampler* sampler;
+    bool srgb;
+    Format format;
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    int mipLevels = 0; // levels of the full chain, 0 until storage is allocated
+    int residentLevel = 0; // finest level uploaded so far, sampling is clamped to it
+    size_t memorySize = 0; // bytes of the full mip chain on the GPU, counted by the array for packed textures
+    TextureArray* array = nullptr; // set when the texture lives in an array layer instead of its own storage
+    int layer = -1;
+    glm::vec4 uvTransform{1.0f, 1.0f, 0.0f, 0.0f}; // scale and offset from texture coordinates to the layer
+
+    // GPU memory of all loaded textures
+    static size_t& totalMemory() {
+        static size_t total = 0;
+        return total;
+    }
+
+    // load an image and return a TextureData structure with raw data,
+    // keeping the channel count of the source image. the decoded buffer is used as is, no copy
+    static TextureData loadImg(const std::string& imgFilePath) {
+        TextureData textureData;
+
+        // decode straight from the file mapping, as many components as the image has
+        MappedFile file(imgFilePath);
+        if (!file.valid() || file.size() > static_cast<size_t>(INT_MAX))
+            return textureData;
+        stbi_uc *data = stbi_load_from_memory(file.data(), static_cast<int>(file.size()),
+                                              &textureData.width, &textureData.height, &textureData.channels, 0);
+
+        // is the image successfully loaded? the image is released with the last reference
+        if (data != nullptr)
+            textureData.data.reset(data, stbi_image_free);
+
+        return textureData;
+    }
+
+    // build levels 1..n of the mip chain with a 2x2 box filter, see ImageKernels::downsample.
+    // srgb averages the color of 3 and 4 channel images as linear light
+    static std::vector<TextureData> generateMipmaps(const TextureData& base, int channels, bool srgb = false) {
+        std::vector<TextureData> levels;
+        const TextureData* previous = &base;
+        while (previous->width > 1 || previous->height > 1) {
+            TextureData level;
+            level.width = std::max(previous->width / 2, 1);
+            level.height = std::max(previous->height / 2, 1);
+            level.channels = channels;
+            level.data.reset(new unsigned char[static_cast<size_t>(level.width) * level.height * channels],
+                             std::default_delete<unsigned char[]>());
+            ImageKernels::downsample(previous->data.get(), previous->width, previous->height, channels, srgb, level.data.get());
+            levels.push_back(std::move(level));
+            previous = &levels.back();
+        }
+        return levels;
+    }
+
+    // empty texture, storage is allocated and filled by TextureLoader or fill()
+    // srgb selects the sRGB internal formats for color images, grayscale data is always linear
+    explicit Texture(bool srgb = false, Sampler* sampler = Sampler::get()): sampler(sampler), srgb(srgb) {
+        glGenTextures(1, &texture);
+    }
+    ~Texture() {
+        glDeleteTextures(1, &texture);
+        RenderState::get().forgetTexture(texture);
+        totalMemory() -= memorySize;
+        if (array)
+            array->release(layer);
+    }
+
+    // 1x1 white texture bound in place of textures that are not resident yet
+    static Texture* placeholder() {
+        static Texture* texture = nullptr;
+        if (!texture) {
+            static unsigned char white[] = {255, 255, 255, 255};
+            TextureData data;
+            data.width = data.height = 1;
+            data.channels = 4;
+            data.data.reset(white, [](unsigned char*) {});
+            texture = new Texture();
+            texture->allocate(data.width, data.height, data.channels);
+            texture->uploadLevel(0, data);
+        }
+        return texture;
+    }
+
+    // packed textures share the base level of their array, so they are resident once complete
+    bool resident() const {
+        return array ? residentLevel == 0 : residentLevel < mipLevels;
+    }
+
+    // allocate the whole chain once, every level is filled with glTex(Compressed)SubImage2D
+    void allocate(int _width, int _height, int _channels, bool compressed = false) {
+        width = _width;
+        height = _height;
+        channels = std::max(_channels, 1);
+        format = compressed ? Format::forCompressedChannels(channels, srgb) : Format::forChannels(channels, srgb);
+        mipLevels = 1 + static_cast<int>(std::floor(std::log2(std::max(std::max(width, height), 1))));
+        residentLevel = mipLevels;
+
+        RenderState::get().bindTexture(0, GL_TEXTURE_2D, texture);
+        glTexStorage2D(GL_TEXTURE_2D, mipLevels, format.internalFormat, width, height);
+        glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, format.swizzle);
+
+        memorySize = storageSize(width, height, channels, compressed);
+        totalMemory() += memorySize;
+    }
+    // take a layer of a shared array instead of storage of its own, see TexturePacker.
+    // the image sits in the lower left corner of the layer if it is smaller
+    void allocateLayer(TextureArray* _array, int _layer, int _width, int _height, int _channels, bool compressed) {
+        array = _array;
+        layer = _layer;
+        width = _width;
+        height = _height;
+        channels = std::max(_channels, 1);
+        format = compressed ? Format::forCompressedChannels(channels, srgb) : Format::forChannels(channels, srgb);
+        mipLevels = array->mipLevels;
+        residentLevel = mipLevels;
+        // map the edges to texel centers, so filtering at level 0 never reaches the unused part
+        if (width != array->width || height != array->height) {
+            uvTransform = glm::vec4((width - 1.0f) / array->width, (height - 1.0f) / array->height,
+                                    0.5f / array->width, 0.5f / array->height);
+        }
+    }
+    // upload one level, levels are expected from the coarsest to the finest and
+    // sampling is clamped to the uploaded ones, so the texture sharpens as data arrives
+    void uploadLevel(int level, const TextureData& image) {
+        if (array)
+            RenderState::get().bindTexture(0, GL_TEXTURE_2D_ARRAY, array->texture);
+        else
+            RenderState::get().bindTexture(0, GL_TEXTURE_2D, texture);
+        if (image.compressed)
+            uploadCompressedLevel(level, image);
+        else
+            uploadUncompressedLevel(level, image);
+        if (array && image.width == 1 && image.height == 1) {
+            // the chain of an image smaller than its array ends early, its last texel fills the remaining levels
+            for (int coarser = level + 1; coarser < mipLevels; ++coarser) {
+                if (image.compressed)
+                    uploadCompressedLevel(coarser, image);
+                else
+                    uploadUncompressedLevel(coarser, image);
+            }
+        }
+        if (level < residentLevel) {
+            residentLevel = level;
+            if (!array) {
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, residentLevel);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mipLevels - 1);
+            }
+        }
+    }
+    // write a region of a level, into the texture's own storage or its array layer
+    void subImage(int level, int y, int regionWidth, int regionHeight, GLsizei size, const void* pixels) {
+        if (array && format.compressed) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y, layer, regionWidth, regionHeight, 1,
+                                      format.internalFormat, size, pixels);
+        } else if (array) {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, y, layer, regionWidth, regionHeight, 1,
+                            format.format, GL_UNSIGNED_BYTE, pixels);
+        } else if (format.compressed) {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, y, regionWidth, regionHeight, format.internalFormat, size, pixels);
+        } else {
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, y, regionWidth, regionHeight, format.format, GL_UNSIGNED_BYTE, pixels);
+        }
+    }
+    void uploadUncompressedLevel(int level, const TextureData& image) {
+        const size_t rowSize = static_cast<size_t>(image.width) * image.channels;
+        const size_t size = rowSize * image.height;
+        const unsigned char* source = image.data.get();
+        // rows of 1 and 3 channel images are not 4-byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        PixelUploadBuffer& staging = PixelUploadBuffer::get();
+        size_t offset = 0;
+        unsigned char* destination = staging.map(size, offset);
+        if (destination) {
+            // mirror vertically to comply with the OpenGL convention
+            ImageKernels::flipRows(source, destination, rowSize, image.height);
+            staging.bind();
+            subImage(level, 0, image.width, image.height, static_cast<GLsizei>(size), reinterpret_cast<const void*>(offset));
+            staging.unbind();
+        } else {
+            // larger than the whole ring, upload row by row from client memory instead
+            for (int y = 0; y < image.height; ++y)
+                subImage(level, y, image.width, 1, static_cast<GLsizei>(rowSize), source + (image.height - 1 - y) * rowSize);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+    // blocks are already in OpenGL row order, so they are copied as one piece
+    void uploadCompressedLevel(int level, const TextureData& image) {
+        const GLsizei size = static_cast<GLsizei>(image.size());
+        // compressed regions have to cover whole blocks unless they end at the edge of the level,
+        // which only matters inside a larger array layer
+        const int levelWidth = std::max((array ? array->width : width) >> level, 1);
+        const int levelHeight = std::max((array ? array->height : height) >> level, 1);
+        const int regionWidth = std::min((image.width + 3) / 4 * 4, levelWidth);
+        const int regionHeight = std::min((image.height + 3) / 4 * 4, levelHeight);
+        PixelUploadBuffer& staging = PixelUploadBuffer::get();
+        size_t offset = 0;
+        unsigned char* destination = staging.map(size, offset);
+        if (destination) {
+            memcpy(destination, image.data.get(), size);
+            staging.bind();
+            subImage(level, 0, regionWidth, regionHeight, size, reinterpret_cast<const void*>(offset));
+            staging.unbind();
+        } else {
+            subImage(level, 0, regionWidth, regionHeight, size, image.data.get());
+        }
+    }
+    // fill the texture right away from a decoded image and its mip chain
+    void fill(const std::vector<TextureData>& levels) {
+        allocate(levels[0].width, levels[0].height, levels[0].channels, levels[0].compressed);
+        for (size_t i = levels.size(); i-- > 0;)
+            uploadLevel(static_cast<int>(i), levels[i]);
+    }
+
+    // bytes of the full mip chain of an image, as stored by allocate()
+    static size_t storageSize(int width, int height, int channels, bool compressed) {
+        size_t size = 0;
+        TextureData level;
+        level.channels = channels;
+        level.compressed = compressed;
+        for (int i = 0; (width >> i) > 0 || (height >> i) > 0; ++i) {
+            level.width = std::max(width >> i, 1);
+            level.height = std::max(height >> i, 1);
+            size += level.size();
+        }
+        return size;
+    }
+    // bytes of a mip chain with the given texel size
+    static size_t chainSize(int width, int height, int levels, int bytesPerTexel) {
+        size_t size = 0;
+        for (int level = 0; level < levels; ++level) {
+            size += static_cast<size_t>(std::max(width >> level, 1)) * std::max(height >> level, 1) * bytesPerTexel;
+        }
+        return size;
+    }
+
+    void bind(unsigned int slot) const {
+        if (array && resident()) {
+            array->bind(slot);
+            return;
+        }
+        const Texture* bound = resident() ? this : placeholder();
+        RenderState::get().bindTexture(slot, GL_TEXTURE_2D, bound->texture);
+        sampler->bind(slot);
+    }
+
+    static void unbind(unsigned int slot) {
+        RenderState::get().bindTexture(slot, GL_TEXTURE_2D, 0);
+    }
+};
+// block-compressed mip chains stored beside their source image as "<source>.bctex", built on the
+// first load or offline with --compress-textures, and used while they are not older than the source
+class CompressedTextureCache {
+public:
+    // bump whenever the encoder or the file layout changes, older files are then rebuilt
+    static const uint32_t VERSION = 2;
+
+    static std::string pathFor(const std::string& source) {
+        return source + ".bctex";
+    }
+
+    // encode every level of an uncompressed chain
+    static std::vector<Texture::TextureData> compress(const std::vector<Texture::TextureData>& levels) {
+        std::vector<Texture::TextureData> compressed;
+        for (const Texture::TextureData& level : levels) {
+            Texture::TextureData blocks = level;
+            blocks.compressed = true;
+            blocks.data.reset(new unsigned char[blocks.size()], std::default_delete<unsigned char[]>());
+            BlockCompressor::compress(level.data.get(), level.width, level.height, level.channels, blocks.data.get());
+            compressed.push_back(std::move(blocks));
+        }
+        return compressed;
+    }
+
+    // read the cached chain of source, false if there is none, it is stale, it was written by another
+    // version or its mip levels were filtered for the other color space
+    static bool load(const std::string& source, std::vector<Texture::TextureData>& levels, bool srgb) {
+        const std::string path = pathFor(source);
+        struct stat sourceStat{}, cacheStat{};
+        if (stat(path.c_str(), &cacheStat) != 0)
+            return false;
+        // a cache without its source is used as is, so caches can ship alone. mtime has a granularity of
+        // a second, a cache from the same second as its source may predate the edit and is rebuilt
+        if (stat(source.c_str(), &sourceStat) == 0 && cacheStat.st_mtime <= sourceStat.st_mtime)
+            return false;
+
+        MappedFile file(path);
+        Header header{};
+        if (!file.valid() || file.size() < sizeof(header))
+            return false;
+        memcpy(&header, file.data(), sizeof(header));
+        if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION ||
+            header.channels < 1 || header.channels > 4 || header.levels == 0 || header.srgb != (srgb ? 1u : 0u) ||
+            header.width == 0 || header.height == 0 || header.width > MAX_SIZE || header.height > MAX_SIZE ||
+            header.levels > maxLevels(std::max(header.width, header.height)))
+            return false;
+        levels.clear();
+        size_t offset = sizeof(header);
+        for (uint32_t i = 0; i < header.levels; ++i) {
+            Texture::TextureData level;
+            level.width = std::max<int>(header.width >> i, 1);
+            level.height = std::max<int>(header.height >> i, 1);
+            level.channels = static_cast<int>(header.channels);
+            level.compressed = true;
+            if (offset + level.size() > file.size()) {
+                levels.clear();
+                return false;
+            }
+            level.data.reset(new unsigned char[level.size()], std::default_delete<unsigned char[]>());
+            memcpy(level.data.get(), file.data() + offset, level.size());
+            offset += level.size();
+            levels.push_back(std::move(level));
+        }
+        return true;
+    }
+
+    // write a compressed chain, through a temporary file so readers never see half of it
+    static bool store(const std::string& source, const std::vector<Texture::TextureData>& levels, bool srgb) {
+        const std::string path = pathFor(source);
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            Header header{};
+            memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.width = static_cast<uint32_t>(levels[0].width);
+            header.height = static_cast<uint32_t>(levels[0].height);
+            header.channels = static_cast<uint32_t>(levels[0].channels);
+            header.levels = static_cast<uint32_t>(levels.size());
+            header.srgb = srgb ? 1u : 0u;
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            for (const Texture::TextureData& level : levels)
+                file.write(reinterpret_cast<const char*>(level.data.get()), static_cast<std::streamsize>(level.size()));
+            if (!file) {
+                std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+                return false;
+            }
+        }
+        std::remove(path.c_str());
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static constexpr const char* MAGIC = "BCTX";
+    static const uint32_t MAX_SIZE = 1 << 16; // pixels on a side, well beyond what GL_MAX_TEXTURE_SIZE allows
+
+    // 1 + floor(log2(size)), the levels of a full chain down to 1x1
+    static uint32_t maxLevels(uint32_t size) {
+        uint32_t levels = 1;
+        while (size >>= 1)
+            ++levels;
+        return levels;
+    }
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t channels;
+        uint32_t levels;
+        uint32_t srgb; // mip levels were averaged as linear light
+    };
+};
+// packs textures into layers of shared TextureArray objects, grouped by internal format, power of two
+// size class and sampler, so a frame binds one array for every texture of a group instead of one
+// texture per node. images smaller than their class are reached through Texture::uvTransform,
+// their coarsest mip levels can pick up a little of the unused part of the layer at the edges
+class TexturePacker {
+public:
+    static const int INITIAL_LAYERS = 4;
+
+    // give the texture an array layer, false if it has to get storage of its own
+    bool allocate(Texture& texture, int width, int height, int channels, bool compressed) {
+        const int classWidth = sizeClass(width);
+        const int classHeight = sizeClass(height);
+        // a repeating image has to fill its layer
+        if (texture.sampler->parameters.wrap != GL_CLAMP_TO_EDGE && (classWidth != width || classHeight != height))
+            return false;
+        const Texture::Format format = compressed ? Texture::Format::forCompressedChannels(channels, texture.srgb)
+                                                  : Texture::Format::forChannels(channels, texture.srgb);
+        TextureArray* array = nullptr;
+        for (auto& candidate : arrays) {
+            if (candidate->internalFormat == format.internalFormat && candidate->width == classWidth &&
+                candidate->height == classHeight && candidate->sampler == texture.sampler) {
+                array = candidate.get();
+                break;
+            }
+        }
+        if (!array) {
+            arrays.emplace_back(new TextureArray(format.internalFormat, format.swizzle, classWidth, classHeight, texture.sampler,
+                                                 Texture::storageSize(classWidth, classHeight, channels, compressed)));
+            array = arrays.back().get();
+        }
+        int layer = array->acquire();
+        if (layer < 0) {
+            GLint maxLayers = 0;
+            glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+            if (array->capacity >= maxLayers)
+                return false;
+            Texture::totalMemory() -= array->memorySize;
+            array->grow(std::min(std::max(array->capacity * 2, INITIAL_LAYERS), static_cast<int>(maxLayers)));
+            Texture::totalMemory() += array->memorySize;
+            layer = array->acquire();
+        }
+        texture.allocateLayer(array, layer, width, height, channels, compressed);
+        return true;
+    }
+    size_t arrayCount() const {
+        return arrays.size();
+    }
+
+private:
+    // arrays are kept for the lifetime of the packer, freed layers are reused
+    std::vector<std::unique_ptr<TextureArray>> arrays;
+
+    static int sizeClass(int size) {
+        int result = 1;
+        while (result < size)
+            result <<= 1;
+        return result;
+    }
+};
+// fixed set of worker threads running queued jobs, shared by the asset loaders
+class ThreadPool {
+public:
+    static ThreadPool& get() {
+        static ThreadPool* pool = new ThreadPool(std::max(std::thread::hardware_concurrency(), 2u) - 1);
+        return *pool;
+    }
+
+    template<typename F>
+    std::future<typename std::result_of<F()>::type> submit(F job) {
+        typedef typename std::result_of<F()>::type Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.emplace_back([task]() { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+    size_t size() const {
+        return workers.size();
+    }
+    // run job(i) for every i below count on up to threads threads (0 for all), the calling thread
+    // included, and return once all are done. indices are handed out one at a time, workers that only
+    // get to the job after the last index was taken return without touching it
+    void parallelFor(size_t count, const std::function<void(size_t)>& job, size_t threads = 0) {
+        struct State {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        if (count == 0)
+            return;
+        auto state = std::make_shared<State>();
+        const std::function<void(size_t)>* work = &job;
+        auto run = [state, work, count]() {
+            for (size_t i = state->next++; i < count; i = state->next++) {
+                (*work)(i);
+                if (++state->done == count) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->finished.notify_all();
+                }
+            }
+        };
+        const size_t helpers = std::min(std::min(threads ? threads - 1 : workers.size(), workers.size()), count - 1);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (size_t i = 0; i < helpers; ++i)
+                jobs.emplace_back(run);
+        }
+        wake.notify_all();
+        run();
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, [&]() { return state->done == count; });
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+
+    explicit ThreadPool(unsigned int count) {
+        for (unsigned int i = 0; i < count; ++i) {
+            workers.emplace_back([this]() {
+                for (;;) {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(mutex);
+                        wake.wait(lock, [this]() { return !jobs.empty(); });
+                        job = std::move(jobs.front());
+                        jobs.pop_front();
+                    }
+                    job();
+                }
+            });
+            // the pool lives until the process exits
+            workers.back().detach();
+        }
+    }
+};
+// decodes images and builds their mip chains on the thread pool, the main thread then
+// uploads finished levels under a per-frame byte budget, coarsest level first.
+// textures draw with the placeholder until their first level is resident.
+// formats the driver can sample block-compressed are read from CompressedTextureCache
+// instead of being decoded, and the cache is written when it is missing or stale
+class TextureLoader {
+public:
+    size_t uploadBudget; // bytes uploaded per frame, at least one level is always uploaded
+    bool useCompressedCache = true;
+    TexturePacker* packer = nullptr; // puts loaded textures into shared array layers if set
+
+    explicit TextureLoader(size_t uploadBudget = 4 << 20): uploadBudget(uploadBudget) {}
+
+    // mask for loadLevels of the channel counts the driver samples block-compressed
+    static unsigned int compressibleChannels(bool srgb) {
+        unsigned int compressible = 0;
+        for (int channels = 1; channels <= 4; ++channels) {
+            if (Texture::Format::compressionSupported(channels, srgb))
+                compressible |= 1u << channels;
+        }
+        return compressible;
+    }
+    // load the chain of one image on the calling thread, compressing channel counts set in
+    // the compressible mask (bit n for n channels). srgb filters the mip levels in linear light
+    static std::vector<Texture::TextureData> loadLevels(const std::string& filename, unsigned int compressible, bool srgb = false) {
+        std::vector<Texture::TextureData> levels;
+        if (compressible && CompressedTextureCache::load(filename, levels, srgb) && (compressible >> levels[0].channels & 1))
+            return levels;
+        levels.clear();
+        levels.push_back(Texture::loadImg(filename));
+        if (!levels[0].data)
+            return levels;
+        std::vector<Texture::TextureData> mipmaps = Texture::generateMipmaps(levels[0], levels[0].channels, srgb);
+        levels.insert(levels.end(), mipmaps.begin(), mipmaps.end());
+        if (compressible >> levels[0].channels & 1) {
+            levels = CompressedTextureCache::compress(levels);
+            CompressedTextureCache::store(filename, levels, srgb);
+        }
+        return levels;
+    }
+
+    // the texture is returned at once and becomes resident over the next frames
+    std::shared_ptr<Texture> load(const std::string& filename, bool srgb = false, Sampler* sampler = Sampler::get()) {
+        auto texture = std::make_shared<Texture>(srgb, sampler);
+        Job job;
+        job.texture = texture;
+        job.filename = filename;
+        job.start = std::chrono::steady_clock::now();
+        // driver support is queried here, the workers have no context
+        const unsigned int compressible = useCompressedCache ? compressibleChannels(srgb) : 0;
+        job.levels = ThreadPool::get().submit([filename, compressible, srgb]() {
+            return loadLevels(filename, compressible, srgb);
+        });
+        jobs.push_back(std::move(job));
+        return texture;
+    }
+    // upload what the workers have finished, called once per frame
+    void update() {
+        size_t uploaded = 0;
+        for (auto it = jobs.begin(); it != jobs.end();) {
+            Job& job = *it;
+            if (job.ready.empty()) {
+                if (job.levels.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                    ++it;
+                    continue;
+                }
+                job.ready = job.levels.get();
+                if (!job.ready[0].data) {
+                    std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESSFULLY_READ: " << job.filename << std::endl;
+                    it = jobs.erase(it);
+                    continue;
+                }
+                const Texture::TextureData& base = job.ready[0];
+                if (!packer || !packer->allocate(*job.texture, base.width, base.height, base.channels, base.compressed))
+                    job.texture->allocate(base.width, base.height, base.channels, base.compressed);
+                job.nextLevel = static_cast<int>(job.ready.size()) - 1;
+                job.decodeTime = elapsedMilliseconds(job.start);
+            }
+            while (job.nextLevel >= 0) {
+                const Texture::TextureData& level = job.ready[job.nextLevel];
+                size_t size = level.size();
+                if (uploaded > 0 && uploaded + size > uploadBudget)
+                    return;
+                job.texture->uploadLevel(job.nextLevel, level);
+                job.ready[job.nextLevel].data.reset();
+                uploaded += size;
+                --job.nextLevel;
+            }
+            const Texture* texture = job.texture.get();
+            const int levels = 1 + static_cast<int>(std::floor(std::log2(std::max(texture->width, texture->height))));
+            std::string placement;
+            if (texture->array) {
+                placement = " in layer " + std::to_string(texture->layer) + " of a " + std::to_string(texture->array->width) +
+                            "x" + std::to_string(texture->array->height) + " array";
+            }
+            printf("Loaded texture \"%s\", %dx%d, %d channel(s) as %s%s, %.1f KB (%.1f KB as GL_RGBA32F), "
+                   "decoded in %.2f ms, resident after %.2f ms\n",
+                   job.filename.c_str(), texture->width, texture->height, texture->channels, texture->format.name,
+                   placement.c_str(), Texture::storageSize(texture->width, texture->height, texture->channels, texture->format.compressed) / 1024.0,
+                   Texture::chainSize(texture->width, texture->height, levels, 16) / 1024.0,
+                   job.decodeTime, elapsedMilliseconds(job.start));
+            it = jobs.erase(it);
+        }
+    }
+    size_t pendingCount() const {
+        return jobs.size();
+    }
+
+private:
+    struct Job {
+        std::shared_ptr<Texture> texture; // keeps the texture alive until it is uploaded
+        std::string filename;
+        std::chrono::steady_clock::time_point start;
+        double decodeTime = 0.0;
+        std::future<std::vector<Texture::TextureData>> levels;
+        std::vector<Texture::TextureData> ready;
+        int nextLevel = 0;
+    };
+    std::list<Job> jobs;
+};
+// geometry of an OBJ file, parsed in place from its bytes without copying lines into strings.
+// polygons are fan-triangulated, which matches tinyobj for the convex faces exporters write.
+// groups, objects and materials are ignored, the model is drawn as one mesh
+struct ObjMesh {
+    static const size_t CHUNK_SIZE = 1 << 20; // smaller files are parsed on the calling thread alone
+
+    std::vector<float> positions; // xyz per vertex
+    std::vector<float> normals; // xyz per normal
+    std::vector<float> texcoords; // uv per texture coordinate
+    std::vector<tinyobj::index_t> indices; // three corners per triangle, -1 where an attribute is missing
+
+    // whether a resolved 0-based index names one of the count elements of its attribute, the rule of
+    // both importers, as tinyobj::LoadObj rejects indices out of bounds
+    static bool inRange(int index, size_t count) {
+        return index >= 0 && static_cast<size_t>(index) < count;
+    }
+
+    // false if a line is malformed, error then names the first one. the text is split into newline aligned
+    // chunks of about chunkSize bytes, parsed on up to threads threads (0 for all) into buffers of their own
+    // and then copied into place at offsets from the prefix sums of their element counts
+    bool parse(const char* begin, const char* end, std::string& error, size_t chunkSize = CHUNK_SIZE, size_t threads = 0) {
+        const size_t size = static_cast<size_t>(end - begin);
+        std::vector<Chunk> chunks(std::max<size_t>(size / std::max<size_t>(chunkSize, 1), 1));
+        const char* chunkBegin = begin;
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            const char* split = std::max(chunkBegin, begin + size / chunks.size() * (i + 1));
+            const char* newline = i + 1 < chunks.size() && split < end
+                                  ? static_cast<const char*>(memchr(split, '\n', static_cast<size_t>(end - split))) : nullptr;
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = newline ? newline + 1 : end;
+            chunkBegin = chunks[i].end;
+        }
+        auto parseChunk = [&chunks](size_t i) { chunks[i].parse(); };
+        if (chunks.size() == 1)
+            parseChunk(0);
+        else
+            ThreadPool::get().parallelFor(chunks.size(), parseChunk, threads);
+
+        // where every chunk starts in the merged arrays, relative indices count back from there
+        struct Offsets {
+            size_t positions, normals, texcoords, indices;
+            int lines;
+        };
+        std::vector<Offsets> offsets(chunks.size() + 1);
+        offsets[0] = {positions.size(), normals.size(), texcoords.size(), indices.size(), 0};
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            offsets[i + 1] = {offsets[i].positions + chunks[i].positions.size(), offsets[i].normals + chunks[i].normals.size(),
+                              offsets[i].texcoords + chunks[i].texcoords.size(), offsets[i].indices + chunks[i].indices.size(),
+                              offsets[i].lines + chunks[i].lines};
+        }
+        // positive indices may name elements later in the file, so they are checked against the merged counts
+        const size_t counts[3] = {offsets.back().positions / 3, offsets.back().texcoords / 2, offsets.back().normals / 3};
+        for (size_t i = 0; i < chunks.size(); ++i) {
+            const int base[3] = {static_cast<int>(offsets[i].positions / 3), static_cast<int>(offsets[i].texcoords / 2),
+                                 static_cast<int>(offsets[i].normals / 3)};
+            // the fixups and corners come before the first malformed line of the chunk, so the earliest
+            // error of the chunk is the first in the file
+            int errorLine = chunks[i].errorLine;
+            for (const Fixup& fixup : chunks[i].fixups) {
+                int& index = fixup.attribute == 0 ? chunks[i].indices[fixup.index].vertex_index
+                           : fixup.attribute == 1 ? chunks[i].indices[fixup.index].texcoord_index
+                                                  : chunks[i].indices[fixup.index].normal_index;
+                index += base[fixup.attribute];
+                if (index < 0) {
+                    errorLine = errorLine >= 0 ? std::min(errorLine, fixup.line) : fixup.line;
+                    break;
+                }
+            }
+            for (size_t c = 0; c < chunks[i].indices.size(); ++c) {
+                const tinyobj::index_t& corner = chunks[i].indices[c];
+                if (!inRange(corner.vertex_index, counts[0]) ||
+                    (corner.texcoord_index != -1 && !inRange(corner.texcoord_index, counts[1])) ||
+                    (corner.normal_index != -1 && !inRange(corner.normal_index, counts[2]))) {
+                    const int line = chunks[i].lineOfIndex(c);
+                    errorLine = errorLine >= 0 ? std::min(errorLine, line) : line;
+                    break;
+                }
+            }
+            if (errorLine >= 0) {
+                error = "malformed line " + std::to_string(offsets[i].lines + errorLine + 1);
+                return false;
+            }
+        }
+
+        if (chunks.size() == 1 && positions.empty() && normals.empty() && texcoords.empty() && indices.empty()) {
+            positions.swap(chunks[0].positions);
+            normals.swap(chunks[0].normals);
+            texcoords.swap(chunks[0].texcoords);
+            indices.swap(chunks[0].indices);
+            return true;
+        }
+        positions.resize(offsets.back().positions);
+        normals.resize(offsets.back().normals);
+        texcoords.resize(offsets.back().texcoords);
+        indices.resize(offsets.back().indices);
+        auto copyChunk = [&](size_t i) {
+            std::copy(chunks[i].positions.begin(), chunks[i].positions.end(), positions.begin() + offsets[i].positions);
+            std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), normals.begin() + offsets[i].normals);
+            std::copy(chunks[i].texcoords.begin(), chunks[i].texcoords.end(), texcoords.begin() + offsets[i].texcoords);
+            std::copy(chunks[i].indices.begin(), chunks[i].indices.end(), indices.begin() + offsets[i].indices);
+        };
+        ThreadPool::get().parallelFor(chunks.size(), copyChunk, threads);
+        return true;
+    }
+
+private:
+    // a negative index that counts back from the end of its chunk, resolved when the chunks before it are known
+    struct Fixup {
+        size_t index; // in the indices of the chunk
+        int attribute; // 0 vertex, 1 texture coordinate, 2 normal
+        int line;
+    };
+    // the records of one newline aligned piece of the text
+    struct Chunk {
+        const char* begin = nullptr;
+        const char* end = nullptr;
+        std::vector<float> positions, normals, texcoords;
+        std::vector<tinyobj::index_t> indices;
+        std::vector<Fixup> fixups;
+        int lines = 0;
+        int errorLine = -1; // first malformed line in the chunk, parsing stops there
+
+        void parse() {
+            std::vector<tinyobj::index_t> face;
+            std::vector<int> relative; // bit per attribute of every corner of the face
+            for (const char* line = begin; line < end; ++lines) {
+                const char* lineEnd = static_cast<const char*>(memchr(line, '\n', static_cast<size_t>(end - line)));
+                if (!lineEnd)
+                    lineEnd = end;
+                const char* p = skipSpace(line, lineEnd);
+                bool ok = true;
+                if (p + 1 < lineEnd && p[0] == 'v' && isSpace(p[1])) {
+                    ok = parseFloats(p + 1, lineEnd, 3, positions);
+                } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 'n' && isSpace(p[2])) {
+                    ok = parseFloats(p + 2, lineEnd, 3, normals);
+                } else if (p + 2 < lineEnd && p[0] == 'v' && p[1] == 't' && isSpace(p[2])) {
+                    ok = parseFloats(p + 2, lineEnd, 2, texcoords);
+                } else if (p + 1 < lineEnd && p[0] == 'f' && isSpace(p[1])) {
+                    ok = parseFace(p + 1, lineEnd, face, relative);
+                }
+                if (!ok) {
+                    errorLine = lines;
+                    return;
+                }
+                line = lineEnd + 1;
+            }
+        }
+        // line of the face the corner at index came from, by counting the corners of the face lines again
+        int lineOfIndex(size_t index) const {
+            size_t faceEnd = 0;
+            int line = 0;
+            for (const char* text = begin; text < end; ++line) {
+                const char* lineEnd = static_cast<const char*>(memchr(text, '\n', static_cast<size_t>(end - text)));
+                if (!lineEnd)
+                    lineEnd = end;
+                const char* p = skipSpace(text, lineEnd);
+                if (p + 1 < lineEnd && p[0] == 'f' && isSpace(p[1])) {
+                    size_t corners = 0;
+                    for (p = skipSpace(p + 1, lineEnd); p < lineEnd; p = skipSpace(tokenEnd(p, lineEnd), lineEnd))
+                        ++corners;
+                    faceEnd += 3 * (corners - 2);
+                    if (index < faceEnd)
+                        return line;
+                }
+                text = lineEnd + 1;
+            }
+            return line;
+        }
+        // v, v/vt, v//vn or v/vt/vn corners, triangulated as a fan around the first corner
+        bool parseFace(const char* p, const char* end, std::vector<tinyobj::index_t>& face, std::vector<int>& relative) {
+            face.clear();
+            relative.clear();
+            for (p = skipSpace(p, end); p < end; p = skipSpace(p, end)) {
+                tinyobj::index_t corner;
+                corner.vertex_index = corner.normal_index = corner.texcoord_index = -1;
+                int flags = 0;
+                if (!parseIndex(p, end, positions.size() / 3, corner.vertex_index, flags, 1))
+                    return false;
+                if (p < end && *p == '/') {
+                    ++p;
+                    if (p < end && *p != '/' && !parseIndex(p, end, texcoords.size() / 2, corner.texcoord_index, flags, 2))
+                        return false;
+                    if (p < end && *p == '/') {
+                        ++p;
+                        if (!parseIndex(p, end, normals.size() / 3, corner.normal_index, flags, 4))
+                            return false;
+                    }
+                }
+                if (p < end && !isSpace(*p))
+                    return false;
+                face.push_back(corner);
+                relative.push_back(flags);
+            }
+            if (face.size() < 3)
+                return false;
+            for (size_t i = 2; i < face.size(); ++i) {
+                for (size_t corner : {static_cast<size_t>(0), i - 1, i}) {
+                    for (int attribute = 0; attribute < 3; ++attribute) {
+                        if (relative[corner] & (1 << attribute))
+                            fixups.push_back({indices.size(), attribute, lines});
+                    }
+                    indices.push_back(face[corner]);
+                }
+            }
+            return true;
+        }
+    };
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\r';
+    }
+    static const char* skipSpace(const char* p, const char* end) {
+        while (p < end && isSpace(*p))
+            ++p;
+        return p;
+    }
+    static const char* tokenEnd(const char* p, const char* end) {
+        while (p < end && !isSpace(*p))
+            ++p;
+        return p;
+    }
+    // the first count numbers of the line, tinyobj's parser keeps the values bit identical
+    static bool parseFloats(const char* p, const char* end, int count, std::vector<float>& values) {
+        for (int i = 0; i < count; ++i) {
+            p = skipSpace(p, end);
+            const char* token = tokenEnd(p, end);
+            double value = 0.0;
+            if (!tinyobj::tryParseDouble(p, token, &value))
+                return false;
+            values.push_back(static_cast<float>(value));
+            p = token;
+        }
+        return true;
+    }
+    // 1-based index, negative ones count back from the last element read so far in the chunk
+    // and set flag in relative. values beyond INT_MAX are malformed
+    static bool parseIndex(const char*& p, const char* end, size_t count, int& index, int& relative, int flag) {
+        bool negative = p < end && *p == '-';
+        if (negative)
+            ++p;
+        int64_t value = 0; // long is 32 bits on Windows
+        const char* digits = p;
+        while (p < end && *p >= '0' && *p <= '9') {
+            value = value * 10 + (*p++ - '0');
+            if (value > INT_MAX)
+                return false;
+        }
+        if (p == digits || value == 0)
+            return false;
+        const int64_t resolved = negative ? static_cast<int64_t>(count) - value : value - 1;
+        if (resolved < INT_MIN || resolved > INT_MAX)
+            return false;
+        index = static_cast<int>(resolved);
+        if (negative)
+            relative |= flag;
+        return true;
+    }
+};
+// how the attributes of a vertex are stored in a vertex buffer. interleaved layouts keep every vertex
+// in one record of stride bytes, planar ones store each attribute as a block of its own.
+// quantized layouts store positions and texture coordinates relative to the bounds of the mesh and
+// normals octahedral encoded into two values, the QUANTIZED shader permutation decodes them with VertexDecode
+struct VertexLayout {
+    enum PositionFormat { POSITION_UNORM16, POSITION_HALF };
+    enum NormalFormat { NORMAL_10_10_10, NORMAL_SNORM8 };
+
+    struct Attribute {
+        GLuint location;
+        GLint components; // as GL reads them
+        GLenum type;
+        GLboolean normalized;
+        size_t offset; // in the record, planar blocks start at offset times the vertex count
+        int sourceComponents; // floats taken from the source stream, the other components are zero
+    };
+
+    std::vector<Attribute> attributes;
+    bool interleaved = true;
+    bool quantized = false;
+    GLsizei stride = 0; // bytes per vertex
+    std::string name;
+
+    // position, normal and texture coordinate as floats at locations 0, 1 and 2
+    static VertexLayout standard(bool interleaved) {
+        VertexLayout layout;
+        layout.interleaved = interleaved;
+        layout.name = interleaved ? "interleaved" : "planar";
+        layout.add(0, 3, GL_FLOAT, GL_FALSE);
+        layout.add(1, 3, GL_FLOAT, GL_FALSE);
+        layout.add(2, 2, GL_FLOAT, GL_FALSE);
+        return layout;
+    }
+    // interleaved 16 byte vertices: 8 bytes of position, 4 of normal and unorm16 texture coordinates
+    static VertexLayout quantizedLayout(PositionFormat positionFormat, NormalFormat normalFormat) {
+        VertexLayout layout;
+        layout.quantized = true;
+        layout.name = std::string(positionFormat == POSITION_UNORM16 ? "unorm16" : "half") + " position, " +
+                      (normalFormat == NORMAL_10_10_10 ? "10-bit" : "snorm8") + " normal";
+        layout.add(0, 4, positionFormat == POSITION_UNORM16 ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT,
+                   positionFormat == POSITION_UNORM16 ? GL_TRUE : GL_FALSE, 3);
+        if (normalFormat == NORMAL_10_10_10)
+            layout.add(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, 2);
+        else
+            layout.add(1, 2, GL_BYTE, GL_TRUE);
+        layout.add(2, 2, GL_UNSIGNED_SHORT, GL_TRUE);
+        return layout;
+    }
+
+    void add(GLuint location, GLint components, GLenum type, GLboolean normalized, int sourceComponents = 0) {
+        attributes.push_back({location, components, type, normalized, static_cast<size_t>(stride),
+                              sourceComponents ? sourceComponents : components});
+        stride += static_cast<GLsizei>(attributeSize(attributes.back()));
+    }
+    size_t size(size_t vertexCount) const {
+        return static_cast<size_t>(stride) * vertexCount;
+    }
+    // buffer data of this layout from one float stream per attribute, converted the way GL converts
+    // them back: normalized types take values in [0, 1] or [-1, 1] and are rounded to nearest
+    std::vector<unsigned char> pack(const std::vector<const float*>& streams, size_t vertexCount) const {
+        std::vector<unsigned char> data(size(vertexCount));
+        for (size_t a = 0; a < attributes.size(); ++a) {
+            const Attribute& attribute = attributes[a];
+            const size_t step = interleaved ? static_cast<size_t>(stride) : attributeSize(attribute);
+            unsigned char* out = data.data() + attributeOffset(attribute, vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v, out += step)
+                encode(attribute, streams[a] + v * attribute.sourceComponents, out);
+        }
+        return data;
+    }
+    // the source stream of one attribute back from buffer data, as the vertex shader sees it
+    std::vector<float> unpack(const std::vector<unsigned char>& data, size_t vertexCount, size_t index) const {
+        const Attribute& attribute = attributes[index];
+        const size_t step = interleaved ? static_cast<size_t>(stride) : attributeSize(attribute);
+        std::vector<float> values(vertexCount * attribute.sourceComponents);
+        const unsigned char* in = data.data() + attributeOffset(attribute, vertexCount);
+        for (size_t v = 0; v < vertexCount; ++v, in += step)
+            decode(attribute, in, values.data() + v * attribute.sourceComponents);
+        return values;
+    }
+    // point the attributes of the bound vertex array at the bound GL_ARRAY_BUFFER
+    void apply(size_t vertexCount) const {
+        for (const Attribute& attribute : attributes) {
+            glVertexAttribPointer(attribute.location, attribute.components, attribute.type, attribute.normalized,
+                                  interleaved ? stride : 0, (GLvoid*)attributeOffset(attribute, vertexCount));
+            glEnableVertexAttribArray(attribute.location);
+        }
+    }
+
+private:
+    // attributes start on 4 byte boundaries
+    static size_t attributeSize(const Attribute& attribute) {
+        size_t size = 4;
+        switch (attribute.type) {
+        case GL_INT_2_10_10_10_REV:
+            break;
+        case GL_HALF_FLOAT:
+        case GL_UNSIGNED_SHORT:
+            size = attribute.components * 2;
+            break;
+        case GL_BYTE:
+            size = attribute.components;
+            break;
+        default:
+            size = attribute.components * sizeof(float);
+        }
+        return (size + 3) / 4 * 4;
+    }
+    size_t attributeOffset(const Attribute& attribute, size_t vertexCount) const {
+        return interleaved ? attribute.offset : attribute.offset * vertexCount;
+    }
+    static int snorm(float value, int max) {
+        return static_cast<int>(std::lround(std::min(std::max(value, -1.0f), 1.0f) * max));
+    }
+    static void encode(const Attribute& attribute, const float* in, unsigned char* out) {
+        memset(out, 0, attributeSize(attribute));
+        for (int c = 0; c < attribute.sourceComponents; ++c) {
+            switch (attribute.type) {
+            case GL_INT_2_10_10_10_REV: {
+                uint32_t packed;
+                memcpy(&packed, out, sizeof(packed));
+                packed |= (static_cast<uint32_t>(snorm(in[c], 511)) & 0x3ffu) << (10 * c);
+                memcpy(out, &packed, sizeof(packed));
+                break;
+            }
+            case GL_HALF_FLOAT: {
+                uint16_t half = glm::packHalf1x16(in[c]);
+                memcpy(out + c * 2, &half, sizeof(half));
+                break;
+            }
+            case GL_UNSIGNED_SHORT: {
+                uint16_t unorm = static_cast<uint16_t>(std::lround(std::min(std::max(in[c], 0.0f), 1.0f) * 65535.0f));
+                memcpy(out + c * 2, &unorm, sizeof(unorm));
+                break;
+            }
+            case GL_BYTE:
+                out[c] = static_cast<unsigned char>(static_cast<int8_t>(snorm(in[c], 127)));
+                break;
+            default:
+                memcpy(out + c * sizeof(float), in + c, sizeof(float));
+            }
+        }
+    }
+    // signed normalized values map to max(value / max, -1) since OpenGL 4.2
+    static void decode(const Attribute& attribute, const unsigned char* in, float* out) {
+        for (int c = 0; c < attribute.sourceComponents; ++c) {
+            switch (attribute.type) {
+            case GL_INT_2_10_10_10_REV: {
+                uint32_t packed;
+                memcpy(&packed, in, sizeof(packed));
+                int value = static_cast<int32_t>(packed << (22 - 10 * c)) >> 22;
+                out[c] = std::max(value / 511.0f, -1.0f);
+                break;
+            }
+            case GL_HALF_FLOAT: {
+                uint16_t half;
+                memcpy(&half, in + c * 2, sizeof(half));
+                out[c] = glm::unpackHalf1x16(half);
+                break;
+            }
+            case GL_UNSIGNED_SHORT: {
+                uint16_t unorm;
+                memcpy(&unorm, in + c * 2, sizeof(unorm));
+                out[c] = unorm / 65535.0f;
+                break;
+            }
+            case GL_BYTE:
+                out[c] = std::max(static_cast<int8_t>(in[c]) / 127.0f, -1.0f);
+                break;
+            default:
+                memcpy(out + c, in + c * sizeof(float), sizeof(float));
+            }
+        }
+    }
+};
+// how the QUANTIZED shader permutation turns the values of a quantized VertexLayout back into
+// the mesh, identity for float layouts
+struct VertexDecode {
+    glm::vec3 positionScale{1.0f};
+    glm::vec3 positionOffset{0.0f};
+    glm::vec4 texcoordTransform{1.0f, 1.0f, 0.0f, 0.0f}; // scale in xy and offset in zw
+
+    // a unit vector projected onto the octahedron, the lower half folded over the diagonals
+    static glm::vec2 encodeNormal(glm::vec3 normal) {
+        normal /= std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+        glm::vec2 encoded(normal.x, normal.y);
+        if (normal.z < 0.0f) {
+            encoded = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) *
+                      glm::vec2(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return encoded;
+    }
+    // same as decodeNormal in uber.vs.glsl
+    static glm::vec3 decodeNormal(glm::vec2 encoded) {
+        glm::vec3 normal(encoded, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+        if (normal.z < 0.0f) {
+            glm::vec2 folded = (1.0f - glm::abs(glm::vec2(normal.y, normal.x))) *
+                               glm::vec2(normal.x >= 0.0f ? 1.0f : -1.0f, normal.y >= 0.0f ? 1.0f : -1.0f);
+            normal.x = folded.x;
+            normal.y = folded.y;
+        }
+        return glm::normalize(normal);
+    }
+};
+// triangle orders for the post-transform vertex cache and for overdraw, on indexed triangle lists.
+// the cache is modelled as a FIFO of CACHE_SIZE vertices, a vertex misses when more than CACHE_SIZE
+// misses happened since it was last transformed
+class MeshOptimizer {
+public:
+    static const unsigned int CACHE_SIZE = 16;
+
+    struct CacheStats {
+        float acmr = 0.0f; // transformed vertices per triangle, 0.5 is the best a regular grid reaches
+        float atvr = 0.0f; // transformed vertices per vertex, 1 is the best
+    };
+
+    static CacheStats analyze(const std::vector<uint32_t>& indices, size_t vertexCount) {
+        std::vector<unsigned int> timestamps(vertexCount, 0);
+        std::vector<bool> used(vertexCount, false);
+        unsigned int time = CACHE_SIZE + 1;
+        size_t misses = 0, unique = 0;
+        for (uint32_t index : indices) {
+            if (time - timestamps[index] > CACHE_SIZE) {
+                timestamps[index] = time++;
+                ++misses;
+            }
+            if (!used[index]) {
+                used[index] = true;
+                ++unique;
+            }
+        }
+        CacheStats stats;
+        stats.acmr = indices.empty() ? 0.0f : static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+        stats.atvr = unique == 0 ? 0.0f : static_cast<float>(misses) / static_cast<float>(unique);
+        return stats;
+    }
+
+    // Tipsify (Sander, Nehab and Barczak 2007): triangles are emitted as fans around one vertex at a time,
+    // the next fan picked among the vertices just used by how long they will stay in the cache
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount) {
+        const size_t triangleCount = indices.size() / 3;
+        // triangles around every vertex
+        std::vector<uint32_t> offsets(vertexCount + 1, 0), adjacency(indices.size());
+        for (uint32_t index : indices)
+            ++offsets[index + 1];
+        for (size_t v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        std::vector<uint32_t> live(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < indices.size(); ++i)
+            adjacency[live[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        for (size_t v = 0; v < vertexCount; ++v)
+            live[v] = offsets[v + 1] - offsets[v];
+
+        std::vector<unsigned int> timestamps(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<uint32_t> deadEnds, candidates, result;
+        result.reserve(indices.size());
+        unsigned int time = CACHE_SIZE + 1;
+        size_t cursor = 0;
+        long fan = vertexCount > 0 ? 0 : -1;
+        while (fan >= 0) {
+            candidates.clear();
+            for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+                const uint32_t triangle = adjacency[a];
+                if (emitted[triangle])
+                    continue;
+                for (int corner = 0; corner < 3; ++corner) {
+                    const uint32_t v = indices[triangle * 3 + corner];
+                    result.push_back(v);
+                    deadEnds.push_back(v);
+                    candidates.push_back(v);
+                    --live[v];
+                    if (time - timestamps[v] > CACHE_SIZE)
+                        timestamps[v] = time++;
+                }
+                emitted[triangle] = true;
+            }
+            // the candidate that stays in the cache for its remaining triangles and entered it earliest
+            fan = -1;
+            long best = -1;
+            for (uint32_t v : candidates) {
+                if (live[v] == 0)
+                    continue;
+                long priority = 0;
+                if (time - timestamps[v] + 2 * live[v] <= CACHE_SIZE)
+                    priority = time - timestamps[v];
+                if (priority > best) {
+                    best = priority;
+                    fan = v;
+                }
+            }
+            // dead end, continue from a recently used vertex or else the next one in index order
+            while (fan < 0 && !deadEnds.empty()) {
+                const uint32_t v = deadEnds.back();
+                deadEnds.pop_back();
+                if (live[v] > 0)
+                    fan = v;
+            }
+            while (fan < 0 && cursor < vertexCount) {
+                if (live[cursor] > 0)
+                    fan = static_cast<long>(cursor);
+                ++cursor;
+            }
+        }
+        indices.swap(result);
+    }
+
+    // splits a cache optimized order into clusters where the cache starts over anyway, hard boundaries where
+    // a triangle misses all three vertices and soft ones where a cluster already reached threshold times the
+    // ACMR of its hard cluster. clusters facing away from the center of the mesh are drawn first, so they
+    // occlude the rest of it (Sander et al. 2007, fast linear overdraw)
+    static void optimizeOverdraw(std::vector<uint32_t>& indices, const std::vector<float>& positions, float threshold = 1.05f) {
+        const size_t triangleCount = indices.size() / 3;
+        const size_t vertexCount = positions.size() / 3;
+        if (triangleCount < 2)
+            return;
+        std::vector<unsigned int> timestamps(vertexCount, 0);
+        unsigned int time = CACHE_SIZE + 1;
+        auto misses = [&](size_t triangle) {
+            int count = 0;
+            for (int corner = 0; corner < 3; ++corner) {
+                const uint32_t v = indices[triangle * 3 + corner];
+                if (time - timestamps[v] > CACHE_SIZE) {
+                    timestamps[v] = time++;
+                    ++count;
+                }
+            }
+            return count;
+        };
+        auto flush = [&]() { time += CACHE_SIZE + 1; };
+
+        std::vector<size_t> hard;
+        for (size_t t = 0; t < triangleCount; ++t) {
+            if (misses(t) == 3)
+                hard.push_back(t);
+        }
+        if (hard.empty() || hard[0] != 0)
+            hard.insert(hard.begin(), 0);
+        std::vector<size_t> clusters;
+        for (size_t h = 0; h < hard.size(); ++h) {
+            const size_t begin = hard[h], end = h + 1 < hard.size() ? hard[h + 1] : triangleCount;
+            flush();
+            size_t clusterMisses = 0;
+            for (size_t t = begin; t < end; ++t)
+                clusterMisses += misses(t);
+            const float target = threshold * static_cast<float>(clusterMisses) / static_cast<float>(end - begin);
+            flush();
+            clusters.push_back(begin);
+            size_t runningMisses = 0, runningTriangles = 0;
+            for (size_t t = begin; t < end; ++t) {
+                runningMisses += misses(t);
+                ++runningTriangles;
+                if (t + 1 < end && static_cast<float>(runningMisses) / static_cast<float>(runningTriangles) <= target) {
+                    clusters.push_back(t + 1);
+                    flush();
+                    runningMisses = runningTriangles = 0;
+                }
+            }
+        }
+
+        // area weighted centroid and normal of every cluster
+        auto position = [&](uint32_t v) { return glm::vec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]); };
+        glm::vec3 meshCenter(0.0f);
+        for (size_t v = 0; v < vertexCount; ++v)
+            meshCenter += position(static_cast<uint32_t>(v));
+        meshCenter /= static_cast<float>(vertexCount);
+        std::vector<float> keys(clusters.size());
+        for (size_t c = 0; c < clusters.size(); ++c) {
+            const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            glm::vec3 centroid(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < end; ++t) {
+                const glm::vec3 p0 = position(indices[t * 3]), p1 = position(indices[t * 3 + 1]), p2 = position(indices[t * 3 + 2]);
+                const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                const float a = glm::length(n);
+                centroid += (p0 + p1 + p2) * (a / 3.0f);
+                normal += n;
+                area += a;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            const float length = glm::length(normal);
+            keys[c] = length > 0.0f ? glm::dot(centroid - meshCenter, normal / length) : 0.0f;
+        }
+        std::vector<size_t> order(clusters.size());
+        for (size_t c = 0; c < order.size(); ++c)
+            order[c] = c;
+        std::stable_sort(order.begin(), order.end(), [&keys](size_t a, size_t b) { return keys[a] > keys[b]; });
+        std::vector<uint32_t> result;
+        result.reserve(indices.size());
+        for (size_t c : order) {
+            const size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+        }
+        indices.swap(result);
+    }
+
+    // Garland and Heckbert quadric error metric simplification. edges collapse onto one of their vertices, so
+    // every level indexes the vertices of the full mesh. vertices on open borders, on edges shared by more than
+    // two triangles or on attribute seams, where another vertex has the same position, never move, which keeps
+    // silhouettes and seams closed. the error of a collapse is the distance its quadric estimates, in units of
+    // the positions, and quadrics add up over collapses, so it is measured against the original surface
+    class Simplifier {
+    public:
+        Simplifier(const std::vector<uint32_t>& indices, const std::vector<float>& positions):
+                positions(positions), current(indices) {
+            const size_t vertexCount = positions.size() / 3;
+            // vertices at the same position share one quadric
+            std::vector<uint32_t> order(vertexCount);
+            for (size_t v = 0; v < vertexCount; ++v)
+                order[v] = static_cast<uint32_t>(v);
+            std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+                return std::lexicographical_compare(&this->positions[a * 3], &this->positions[a * 3 + 3],
+                                                    &this->positions[b * 3], &this->positions[b * 3 + 3]);
+            });
+            welded.resize(vertexCount);
+            locked.assign(vertexCount, false);
+            for (size_t i = 0, group = 0; i < vertexCount; ++i) {
+                if (i > 0 && !std::equal(&positions[order[i] * 3], &positions[order[i] * 3 + 3], &positions[order[i - 1] * 3]))
+                    ++group;
+                welded[order[i]] = static_cast<uint32_t>(group);
+            }
+            for (size_t i = 1; i < vertexCount; ++i) {
+                if (welded[order[i]] == welded[order[i - 1]])
+                    locked[order[i]] = locked[order[i - 1]] = true;
+            }
+            // edges not shared by exactly two triangles
+            std::vector<std::pair<uint32_t, uint32_t>> edges;
+            edges.reserve(indices.size());
+            for (size_t i = 0; i < indices.size(); ++i) {
+                const uint32_t a = welded[indices[i]], b = welded[indices[i - i % 3 + (i + 1) % 3]];
+                edges.emplace_back(std::min(a, b), std::max(a, b));
+            }
+            std::sort(edges.begin(), edges.end());
+            std::vector<bool> lockedGroups(vertexCount, false);
+            for (size_t i = 0, end; i < edges.size(); i = end) {
+                for (end = i + 1; end < edges.size() && edges[end] == edges[i]; ++end) {}
+                if (end - i != 2)
+                    lockedGroups[edges[i].first] = lockedGroups[edges[i].second] = true;
+            }
+            for (size_t v = 0; v < vertexCount; ++v) {
+                if (lockedGroups[welded[v]])
+                    locked[v] = true;
+            }
+            // area weighted planes of the triangles around every position
+            quadrics.resize(vertexCount);
+            for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+                const glm::dvec3 p0 = position(indices[t]), p1 = position(indices[t + 1]), p2 = position(indices[t + 2]);
+                const glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+                const double area = glm::length(normal);
+                if (area <= 0.0)
+                    continue;
+                for (int corner = 0; corner < 3; ++corner)
+                    quadrics[welded[indices[t + corner]]].addPlane(normal / area, -glm::dot(normal / area, p0), area);
+            }
+        }
+
+        // collapse edges cheapest first until at most targetIndexCount indices are left or the cheapest
+        // remaining collapse would exceed maxError. false when nothing could be collapsed
+        bool simplify(size_t targetIndexCount, float maxError) {
+            const size_t vertexCount = positions.size() / 3;
+            bool collapsed = false;
+            std::vector<Collapse> collapses;
+            std::vector<uint32_t> offsets, adjacency;
+            std::vector<bool> touched;
+            while (current.size() > targetIndexCount) {
+                collapses.clear();
+                for (size_t i = 0; i < current.size(); ++i) {
+                    const uint32_t from = current[i], to = current[i - i % 3 + (i + 1) % 3];
+                    if (!locked[from])
+                        collapses.push_back({from, to, cost(from, to)});
+                }
+                std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) { return a.cost < b.cost; });
+                // triangles around every vertex
+                offsets.assign(vertexCount + 1, 0);
+                adjacency.resize(current.size());
+                for (uint32_t index : current)
+                    ++offsets[index + 1];
+                for (size_t v = 0; v < vertexCount; ++v)
+                    offsets[v + 1] += offsets[v];
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (size_t i = 0; i < current.size(); ++i)
+                    adjacency[fill[current[i]]++] = static_cast<uint32_t>(i / 3);
+
+                // one collapse per neighbourhood and pass, so the triangles checked for flips stay as they are
+                touched.assign(vertexCount, false);
+                size_t indexCount = current.size();
+                bool progress = false;
+                for (const Collapse& collapse : collapses) {
+                    if (indexCount <= targetIndexCount || collapse.cost > maxError)
+                        break;
+                    if (touched[collapse.from] || touched[collapse.to] || flips(collapse, offsets, adjacency))
+                        continue;
+                    for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; ++a) {
+                        uint32_t* triangle = &current[adjacency[a] * 3];
+                        if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                            indexCount -= 3;
+                        for (int corner = 0; corner < 3; ++corner) {
+                            touched[triangle[corner]] = true;
+                            if (triangle[corner] == collapse.from)
+                                triangle[corner] = collapse.to;
+                        }
+                    }
+                    quadrics[welded[collapse.to]].add(quadrics[welded[collapse.from]]);
+                    maxCollapseError = std::max(maxCollapseError, collapse.cost);
+                    progress = collapsed = true;
+                }
+                if (!progress)
+                    break;
+                // drop the triangles the collapses have folded
+                size_t kept = 0;
+                for (size_t t = 0; t < current.size(); t += 3) {
+                    if (current[t] == current[t + 1] || current[t + 1] == current[t + 2] || current[t + 2] == current[t])
+                        continue;
+                    std::copy_n(current.begin() + t, 3, current.begin() + kept);
+                    kept += 3;
+                }
+                current.resize(kept);
+            }
+            return collapsed;
+        }
+        const std::vector<uint32_t>& indices() const {
+            return current;
+        }
+        // largest error of the collapses taken so far, the bound of the current level
+        float error() const {
+            return maxCollapseError;
+        }
+
+    private:
+        struct Collapse {
+            uint32_t from, to;
+            float cost;
+        };
+        // symmetric 4x4 matrix of the summed planes, upper triangle row by row
+        struct Quadric {
+            double q[10] = {};
+            double weight = 0.0;
+            void addPlane(const glm::dvec3& n, double d, double w) {
+                const double plane[4] = {n.x, n.y, n.z, d};
+                for (int row = 0, i = 0; row < 4; ++row) {
+                    for (int column = row; column < 4; ++column)
+                        q[i++] += w * plane[row] * plane[column];
+                }
+                weight += w;
+            }
+            void add(const Quadric& other) {
+                for (int i = 0; i < 10; ++i)
+                    q[i] += other.q[i];
+                weight += other.weight;
+            }
+            double error(const glm::dvec3& p) const {
+                return q[0] * p.x * p.x + 2.0 * q[1] * p.x * p.y + 2.0 * q[2] * p.x * p.z + 2.0 * q[3] * p.x +
+                       q[4] * p.y * p.y + 2.0 * q[5] * p.y * p.z + 2.0 * q[6] * p.y +
+                       q[7] * p.z * p.z + 2.0 * q[8] * p.z + q[9];
+            }
+        };
+
+        const std::vector<float>& positions;
+        std::vector<uint32_t> current;
+        std::vector<uint32_t> welded; // distinct position of every vertex
+        std::vector<bool> locked;
+        std::vector<Quadric> quadrics; // by welded position
+        float maxCollapseError = 0.0f;
+
+        glm::dvec3 position(uint32_t v) const {
+            return glm::dvec3(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+        }
+        // estimated distance of to from the surface from and to stand for together
+        float cost(uint32_t from, uint32_t to) const {
+            Quadric combined = quadrics[welded[from]];
+            combined.add(quadrics[welded[to]]);
+            if (combined.weight <= 0.0)
+                return 0.0f;
+            return static_cast<float>(std::sqrt(std::max(combined.error(position(to)), 0.0) / combined.weight));
+        }
+        // whether moving from onto to turns any of the triangles that keep both around
+        bool flips(const Collapse& collapse, const std::vector<uint32_t>& offsets, const std::vector<uint32_t>& adjacency) const {
+            for (uint32_t a = offsets[collapse.from]; a < offsets[collapse.from + 1]; ++a) {
+                const uint32_t* triangle = &current[adjacency[a] * 3];
+                if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+                    continue;
+                glm::dvec3 before[3], after[3];
+                for (int corner = 0; corner < 3; ++corner) {
+                    before[corner] = position(triangle[corner]);
+                    after[corner] = triangle[corner] == collapse.from ? position(collapse.to) : before[corner];
+                }
+                if (glm::dot(glm::cross(before[1] - before[0], before[2] - before[0]),
+                             glm::cross(after[1] - after[0], after[2] - after[0])) <= 0.0)
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    // renumbers the vertices in the order the triangles first use them, so fetching them walks the
+    // vertex buffer forward. the streams hold components floats per vertex each
+    static void optimizeVertexFetch(std::vector<uint32_t>& indices, const std::vector<std::pair<std::vector<float>*, int>>& streams) {
+        const size_t vertexCount = streams.empty() ? 0 : streams[0].first->size() / streams[0].second;
+        std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+        uint32_t next = 0;
+        for (uint32_t& index : indices) {
+            if (remap[index] == UINT32_MAX)
+                remap[index] = next++;
+            index = remap[index];
+        }
+        for (const auto& stream : streams) {
+            const int components = stream.second;
+            std::vector<float> reordered(static_cast<size_t>(next) * components);
+            for (size_t v = 0; v < vertexCount; ++v) {
+                if (remap[v] != UINT32_MAX)
+                    std::copy_n(stream.first->begin() + v * components, components, reordered.begin() + remap[v] * components);
+            }
+            stream.first->swap(reordered);
+        }
+    }
+};
+// imported meshes stored beside their source as "<source>.mesh", a header followed by the vertex and
+// index buffer contents already in their upload layout, so loading maps the file and hands the bytes
+// straight to glBufferData instead of parsing the OBJ again. a cache is rebuilt when the hash of the
+// source bytes, the vertex layout or VERSION changes
+class MeshCache {
+public:
+    // bump whenever the vertex encoding or the file layout changes, older files are then rebuilt
+    static const uint32_t VERSION = 3;
+    static const uint32_t MAX_LODS = 8;
+
+    // a level of detail, a range of the index buffer. error bounds how far it strays from the full mesh
+    struct Lod {
+        uint32_t firstIndex;
+        uint32_t indexCount;
+        float error; // in model units
+    };
+
+    // vertex and index buffer contents ready for upload, pointing into a mapped cache file or into
+    // arrays the builder of the mesh owns
+    struct Mesh {
+        int vertexCount = 0;
+        int indexCount = 0; // of all levels
+        GLenum indexType = GL_UNSIGNED_INT;
+        VertexDecode decode;
+        std::vector<Lod> lods; // full mesh first
+        int lodLevels = 1; // requested, the mesh may not simplify into as many
+        glm::vec3 center{0.0f}; // bounding sphere
+        float radius = 0.0f;
+        const unsigned char* vertices = nullptr;
+        size_t vertexSize = 0;
+        const unsigned char* indices = nullptr;
+        size_t indexSize = 0;
+        bool optimized = false; // triangles reordered by MeshOptimizer
+        MeshOptimizer::CacheStats sourceOrder, drawOrder; // of the triangles in the file and as drawn
+    };
+
+    static std::string pathFor(const std::string& source) {
+        return source + ".mesh";
+    }
+
+    // 64-bit FNV-1a over 8 byte words instead of single bytes, so even large OBJs hash in milliseconds.
+    // every step is a bijection, changing any one word always changes the hash
+    static uint64_t hash(const unsigned char* data, size_t size) {
+        return hashWords(14695981039346656037ull ^ size, data, size);
+    }
+    // the same hash of the file at path, read in blocks so it never is in memory whole. false if it cannot be
+    // read, as a hash of 0 would accept any cache
+    static bool hash(const std::string& path, uint64_t& hash) {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+            return false;
+        const size_t size = static_cast<size_t>(file.tellg());
+        file.seekg(0);
+        std::vector<unsigned char> block(HASH_BLOCK_SIZE);
+        hash = 14695981039346656037ull ^ size;
+        for (size_t read = 0; read < size; read += block.size()) {
+            const size_t length = std::min(block.size(), size - read);
+            if (!file.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(length)))
+                return false;
+            hash = hashWords(hash, block.data(), length);
+        }
+        return true;
+    }
+
+    // map the cache of source, file then owns the bytes mesh points into. false if there is none, it
+    // was built from other source bytes, for another vertex layout, triangle order, number of levels of detail
+    // or by another version. sourceHash 0 accepts any source, so caches can ship without their OBJ
+    static bool load(const std::string& source, uint64_t sourceHash, const VertexLayout& layout, bool optimized,
+                     int lodLevels, std::unique_ptr<MappedFile>& file, Mesh& mesh) {
+        file.reset(new MappedFile(pathFor(source)));
+        Header header{};
+        if (!file->valid() || file->size() < sizeof(header))
+            return false;
+        memcpy(&header, file->data(), sizeof(header));
+        if (memcmp(header.magic, MAGIC, sizeof(header.magic)) != 0 || header.version != VERSION ||
+            (sourceHash != 0 && header.sourceHash != sourceHash) || header.layoutHash != layoutHash(layout) ||
+            header.optimized != (optimized ? 1u : 0u) || header.lodLevels != static_cast<uint32_t>(lodLevels) ||
+            header.lodCount == 0 || header.lodCount > MAX_LODS ||
+            (header.indexType != GL_UNSIGNED_SHORT && header.indexType != GL_UNSIGNED_INT))
+            return false;
+        const size_t indexBytes = header.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        const size_t vertexOffset = align(sizeof(header));
+        if (header.vertexSize > file->size() || header.indexSize > file->size())
+            return false;
+        const size_t indexOffset = align(vertexOffset + header.vertexSize);
+        if (header.vertexSize != layout.size(header.vertexCount) || header.indexSize != header.indexCount * indexBytes ||
+            indexOffset + header.indexSize > file->size())
+            return false;
+        for (uint32_t i = 0; i < header.lodCount; ++i) {
+            if (header.lods[i].firstIndex + static_cast<uint64_t>(header.lods[i].indexCount) > header.indexCount)
+                return false;
+        }
+        // a cache accepted without its source must not hand the GPU indices past the vertices
+        if (header.indexCount > 0 && maxIndex(file->data() + indexOffset, header.indexCount, header.indexType) >= header.vertexCount)
+            return false;
+        mesh.vertexCount = static_cast<int>(header.vertexCount);
+        mesh.indexCount = static_cast<int>(header.indexCount);
+        mesh.indexType = header.indexType;
+        memcpy(&mesh.decode.positionScale[0], &header.decode[0], 3 * sizeof(float));
+        memcpy(&mesh.decode.positionOffset[0], &header.decode[3], 3 * sizeof(float));
+        memcpy(&mesh.decode.texcoordTransform[0], &header.decode[6], 4 * sizeof(float));
+        mesh.optimized = optimized;
+        mesh.sourceOrder = {header.cacheStats[0], header.cacheStats[1]};
+        mesh.drawOrder = {header.cacheStats[2], header.cacheStats[3]};
+        mesh.lods.assign(header.lods, header.lods + header.lodCount);
+        mesh.lodLevels = lodLevels;
+        mesh.center = glm::vec3(header.bounds[0], header.bounds[1], header.bounds[2]);
+        mesh.radius = header.bounds[3];
+        mesh.vertices = file->data() + vertexOffset;
+        mesh.vertexSize = static_cast<size_t>(header.vertexSize);
+        mesh.indices = file->data() + indexOffset;
+        mesh.indexSize = static_cast<size_t>(header.indexSize);
+        return true;
+    }
+
+    // write a mesh, through a temporary file so readers never see half of it
+    static bool store(const std::string& source, uint64_t sourceHash, const VertexLayout& layout, const Mesh& mesh) {
+        const std::string path = pathFor(source);
+        const std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            Header header;
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, MAGIC, sizeof(header.magic));
+            header.version = VERSION;
+            header.sourceHash = sourceHash;
+            header.layoutHash = layoutHash(layout);
+            header.vertexSize = mesh.vertexSize;
+            header.indexSize = mesh.indexSize;
+            header.vertexCount = static_cast<uint32_t>(mesh.vertexCount);
+            header.indexCount = static_cast<uint32_t>(mesh.indexCount);
+            header.indexType = mesh.indexType;
+            memcpy(&header.decode[0], &mesh.decode.positionScale[0], 3 * sizeof(float));
+            memcpy(&header.decode[3], &mesh.decode.positionOffset[0], 3 * sizeof(float));
+            memcpy(&header.decode[6], &mesh.decode.texcoordTransform[0], 4 * sizeof(float));
+            header.optimized = mesh.optimized ? 1u : 0u;
+            const float cacheStats[4] = {mesh.sourceOrder.acmr, mesh.sourceOrder.atvr, mesh.drawOrder.acmr, mesh.drawOrder.atvr};
+            memcpy(header.cacheStats, cacheStats, sizeof(cacheStats));
+            header.lodLevels = static_cast<uint32_t>(mesh.lodLevels);
+            header.lodCount = static_cast<uint32_t>(std::min<size_t>(mesh.lods.size(), MAX_LODS));
+            std::copy_n(mesh.lods.begin(), header.lodCount, header.lods);
+            const float bounds[4] = {mesh.center.x, mesh.center.y, mesh.center.z, mesh.radius};
+            memcpy(header.bounds, bounds, sizeof(bounds));
+            // the blobs start aligned, so the mapping can be handed to the driver as it is
+            const char padding[ALIGNMENT] = {};
+            const size_t vertexOffset = align(sizeof(header));
+            const size_t indexOffset = align(vertexOffset + mesh.vertexSize);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(padding, static_cast<std::streamsize>(vertexOffset - sizeof(header)));
+            file.write(reinterpret_cast<const char*>(mesh.vertices), static_cast<std::streamsize>(mesh.vertexSize));
+            file.write(padding, static_cast<std::streamsize>(indexOffset - vertexOffset - mesh.vertexSize));
+            file.write(reinterpret_cast<const char*>(mesh.indices), static_cast<std::streamsize>(mesh.indexSize));
+            if (!file) {
+                std::cout << "ERROR::MESH_CACHE::FILE_NOT_SUCCESSFULLY_WRITTEN: " << path << std::endl;
+                return false;
+            }
+        }
+        std::remove(path.c_str());
+        return std::rename(temporary.c_str(), path.c_str()) == 0;
+    }
+
+private:
+    static constexpr const char* MAGIC = "MESH";
+    static const size_t ALIGNMENT = 16;
+    static const size_t HASH_BLOCK_SIZE = 64 << 10; // a multiple of the word size, only the last block has a tail
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint64_t sourceHash;
+        uint64_t layoutHash;
+        uint64_t vertexSize; // bytes
+        uint64_t indexSize;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t indexType; // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+        float decode[10]; // VertexDecode, position scale and offset then texcoordTransform
+        uint32_t optimized;
+        float cacheStats[4]; // ACMR and ATVR in source order then as drawn
+        uint32_t lodLevels; // requested
+        uint32_t lodCount;
+        Lod lods[MAX_LODS];
+        float bounds[4]; // center and radius
+    };
+
+    // largest of count indices of type, the blob starts aligned for either type
+    static uint32_t maxIndex(const unsigned char* indices, size_t count, GLenum type) {
+        if (type == GL_UNSIGNED_SHORT) {
+            const uint16_t* shortIndices = reinterpret_cast<const uint16_t*>(indices);
+            return *std::max_element(shortIndices, shortIndices + count);
+        }
+        const uint32_t* intIndices = reinterpret_cast<const uint32_t*>(indices);
+        return *std::max_element(intIndices, intIndices + count);
+    }
+    static size_t align(size_t offset) {
+        return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    }
+    static uint64_t hashWords(uint64_t hash, const unsigned char* data, size_t size) {
+        const uint64_t PRIME = 1099511628211ull;
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+            uint64_t word;
+            memcpy(&word, data + i, sizeof(word));
+            hash = (hash ^ word) * PRIME;
+        }
+        for (; i < size; ++i)
+            hash = (hash ^ data[i]) * PRIME;
+        return hash;
+    }
+    // every attribute format and offset, a cache only serves the layout it was written for
+    static uint64_t layoutHash(const VertexLayout& layout) {
+        std::vector<uint32_t> description = {layout.interleaved ? 1u : 0u, static_cast<uint32_t>(layout.stride)};
+        for (const VertexLayout::Attribute& attribute : layout.attributes) {
+            description.insert(description.end(), {attribute.location, static_cast<uint32_t>(attribute.components),
+                                                   attribute.type, attribute.normalized,
+                                                   static_cast<uint32_t>(attribute.offset),
+                                                   static_cast<uint32_t>(attribute.sourceComponents)});
+        }
+        return hash(reinterpret_cast<const unsigned char*>(description.data()), description.size() * sizeof(uint32_t));
+    }
+};
+// vertex and index data of all models sub-allocated out of a few large immutable buffers, one block per
+// interleaved vertex layout at a time with a single vertex array. models are ranges drawn with a base
+// vertex, so draws of the same layout follow each other without binding another vertex array. meshes
+// larger than a block get a block of their own, released with them
+class GeometryArena {
+private:
+    struct Block;
+
+public:
+    struct Allocation {
+        Block* block = nullptr;
+        GLuint vertexArray = 0;
+        GLuint vertexBuffer = 0;
+        GLuint indexBuffer = 0;
+        GLint baseVertex = 0; // first vertex in the block
+        size_t vertexCount = 0;
+        size_t indexOffset = 0; // bytes
+        size_t indexSize = 0;
+    };
+
+    static GeometryArena& get() {
+        // never destroyed, see PixelUploadBuffer::get
+        static GeometryArena* arena = new GeometryArena();
+        return *arena;
+    }
+
+    // room for vertexCount vertices of layout and indexSize bytes of indices, to be filled through the
+    // buffers of allocation. false for planar layouts, their attribute blocks cannot share a buffer
+    bool allocate(const VertexLayout& layout, size_t vertexCount, size_t indexSize, Allocation& allocation) {
+        if (!layout.interleaved || vertexCount == 0)
+            return false;
+        size_t firstVertex = 0, indexOffset = 0;
+        Block* block = nullptr;
+        for (Block& candidate : blocks) {
+            if (candidate.layout != layout.name || candidate.stride != layout.stride ||
+                !candidate.vertices.allocate(vertexCount, 1, firstVertex))
+                continue;
+            if (candidate.indices.allocate(indexSize, INDEX_ALIGNMENT, indexOffset)) {
+                block = &candidate;
+                break;
+            }
+            candidate.vertices.release(firstVertex, vertexCount);
+        }
+        if (!block) {
+            const bool dedicated = layout.size(vertexCount) > BLOCK_VERTEX_BYTES || indexSize > BLOCK_INDEX_BYTES;
+            size_t vertexCapacity = BLOCK_VERTEX_BYTES / layout.stride, indexCapacity = BLOCK_INDEX_BYTES;
+            if (dedicated) {
+                vertexCapacity = vertexCount;
+                indexCapacity = std::max<size_t>(indexSize, 1);
+            }
+            blocks.emplace_back(layout, vertexCapacity, indexCapacity, dedicated);
+            block = &blocks.back();
+            block->vertices.allocate(vertexCount, 1, firstVertex);
+            block->indices.allocate(indexSize, INDEX_ALIGNMENT, indexOffset);
+        }
+        ++block->allocations;
+        used += layout.size(vertexCount) + indexSize;
+        allocation.block = block;
+        allocation.vertexArray = block->vao;
+        allocation.vertexBuffer = block->vbo;
+        allocation.indexBuffer = block->ebo;
+        allocation.baseVertex = static_cast<GLint>(firstVertex);
+        allocation.vertexCount = vertexCount;
+        allocation.indexOffset = indexOffset;
+        allocation.indexSize = indexSize;
+        return true;
+    }
+    // copy vertex and index data into the ranges of allocation
+    static void upload(const Allocation& allocation, const void* vertices, size_t vertexSize, const void* indices) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.vertexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.baseVertex * allocation.block->stride),
+                        static_cast<GLsizeiptr>(vertexSize), vertices);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.indexBuffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(allocation.indexOffset),
+                        static_cast<GLsizeiptr>(allocation.indexSize), indices);
+    }
+    void release(Allocation& allocation) {
+        Block* block = allocation.block;
+        if (!block)
+            return;
+        block->vertices.release(static_cast<size_t>(allocation.baseVertex), allocation.vertexCount);
+        block->indices.release(allocation.indexOffset, allocation.indexSize);
+        used -= allocation.vertexCount * block->stride + allocation.indexSize;
+        allocation.block = nullptr;
+        if (--block->allocations == 0 && block->dedicated) {
+            blocks.remove_if([block](const Block& candidate) { return &candidate == block; });
+        }
+    }
+
+    size_t blockCount() const {
+        return blocks.size();
+    }
+    size_t usedBytes() const {
+        return used;
+    }
+    size_t capacityBytes() const {
+        size_t capacity = 0;
+        for (const Block& block : blocks)
+            capacity += block.vertices.capacity * block.stride + block.indices.capacity;
+        return capacity;
+    }
+
+private:
+    static const size_t BLOCK_VERTEX_BYTES = 16 << 20;
+    static const size_t BLOCK_INDEX_BYTES = 8 << 20;
+    static const size_t INDEX_ALIGNMENT = 4; // 32-bit indices need it, 16-bit ones are kept on it as well
+
+    // first fit over the free ranges, sorted by offset and merged with their neighbours on release
+    struct RangeAllocator {
+        struct Range {
+            size_t offset;
+            size_t size;
+        };
+        size_t capacity;
+        std::vector<Range> free;
+
+        explicit RangeAllocator(size_t capacity): capacity(capacity), free{{0, capacity}} {}
+        bool allocate(size_t size, size_t alignment, size_t& offset) {
+            for (size_t i = 0; i < free.size(); ++i) {
+                const size_t start = (free[i].offset + alignment - 1) / alignment * alignment;
+                const size_t end = free[i].offset + free[i].size;
+                if (start + size > end)
+                    continue;
+                offset = start;
+                const Range before{free[i].offset, start - free[i].offset}, after{start + size, end - start - size};
+                free.erase(free.begin() + static_cast<long>(i));
+                if (after.size > 0)
+                    free.insert(free.begin() + static_cast<long>(i), after);
+                if (before.size > 0)
+                    free.insert(free.begin() + static_cast<long>(i), before);
+                return true;
+            }
+            return false;
+        }
+        void release(size_t offset, size_t size) {
+            if (size == 0)
+                return;
+            auto next = std::lower_bound(free.begin(), free.end(), offset,
+                                         [](const Range& range, size_t value) { return range.offset < value; });
+            next = free.insert(next, {offset, size});
+            if (next + 1 != free.end() && next->offset + next->size == (next + 1)->offset) {
+                next->size += (next + 1)->size;
+                free.erase(next + 1);
+            }
+            if (next != free.begin() && (next - 1)->offset + (next - 1)->size == next->offset) {
+                (next - 1)->size += next->size;
+                free.erase(next);
+            }
+        }
+    };
+    struct Block {
+        std::string layout; // VertexLayout::name
+        GLsizei stride;
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        RangeAllocator vertices; // in vertices
+        RangeAllocator indices; // in bytes
+        int allocations = 0;
+        bool dedicated;
+
+        Block(const VertexLayout& layout, size_t vertexCapacity, size_t indexCapacity, bool dedicated):
+                layout(layout.name), stride(layout.stride), vertices(vertexCapacity), indices(indexCapacity),
+                dedicated(dedicated) {
+            glGenVertexArrays(1, &vao);
+            RenderState::get().bindVertexArray(vao);
+            vbo = createBuffer(GL_ARRAY_BUFFER, layout.size(vertexCapacity));
+            layout.apply(vertexCapacity);
+            // the element buffer binding is part of the vertex array object
+            ebo = createBuffer(GL_ELEMENT_ARRAY_BUFFER, indexCapacity);
+        }
+        ~Block() {
+            glDeleteVertexArrays(1, &vao);
+            glDeleteBuffers(1, &vbo);
+            glDeleteBuffers(1, &ebo);
+            RenderState::get().forgetVertexArray(vao);
+        }
+        Block(const Block&) = delete;
+        Block& operator=(const Block&) = delete;
+
+        // immutable storage where the driver has it, only ever written with glBufferSubData
+        static GLuint createBuffer(GLenum target, size_t size) {
+            GLuint buffer;
+            glGenBuffers(1, &buffer);
+            glBindBuffer(target, buffer);
+            if (GLEW_ARB_buffer_storage)
+                glBufferStorage(target, static_cast<GLsizeiptr>(size), nullptr, GL_DYNAMIC_STORAGE_BIT);
+            else
+                glBufferData(target, static_cast<GLsizeiptr>(size), nullptr, GL_STATIC_DRAW);
+            return buffer;
+        }
+    };
+
+    std::list<Block> blocks;
+    size_t used = 0; // bytes
+};
+class Model {
+public:
+    GLuint vao = 0; // vertex array object
+    GLuint vbo = 0; // vertex buffer object
+    GLuint ebo = 0; // element buffer object
+    GeometryArena::Allocation allocation; // the buffers above belong to the arena while it has a block
+    int vertexCount = 0; // unique vertices
+    int indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT while the vertices fit
+    VertexLayout layout;
+    VertexDecode decode; // set for quantized layouts
+    std::vector<MeshCache::Lod> lods; // levels of detail in the element buffer, the full mesh first
+    glm::vec3 center{0.0f}; // bounding sphere
+    float radius = 0.0f;
+
+    // Load .obj model from its mesh cache, the OBJ is only parsed, straight from the file mapping,
+    // when the cache is missing or stale and the cache is written then. optimizeOrder reorders the
+    // triangles for the vertex cache and overdraw with MeshOptimizer, lodLevels simplifies the mesh
+    // into up to that many levels of detail, the cache keeps the result
+    explicit Model(const std::string& filename, VertexLayout layout = VertexLayout::standard(true), bool optimizeOrder = true,
+                   int lodLevels = 1): layout(std::move(layout)) {
+        MappedFile file(filename);
+        const uint64_t sourceHash = file.valid() ? MeshCache::hash(file.data(), file.size()) : 0;
+        std::unique_ptr<MappedFile> cacheFile;
+        MeshCache::Mesh cached;
+        if (MeshCache::load(filename, sourceHash, this->layout, optimizeOrder, lodLevels, cacheFile, cached)) {
+            create(cached, filename, true);
+            return;
+        }
+        ObjMesh mesh;
+        std::string err;
+        if (!file.valid()) {
+            std::cout << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << filename << std::endl;
+            exit(1);
+        }
+        const char* text = reinterpret_cast<const char*>(file.data());
+        if (!mesh.parse(text, text + file.size(), err)) {
+            std::cout << "ERROR::MODEL::PARSE_FAILED: " << filename << ", " << err << std::endl;
+            exit(1);
+        }
+        std::vector<unsigned char> vertexData, indexData;
+        MeshCache::Mesh built = build(mesh, this->layout, vertexData, indexData, optimizeOrder, lodLevels);
+        create(built, filename, false);
+        MeshCache::store(filename, sourceHash, this->layout, built);
+    }
+    // model of an already parsed or generated mesh, name is only used in the report
+    Model(const ObjMesh& mesh, const std::string& name, VertexLayout layout = VertexLayout::standard(true),
+          bool optimizeOrder = true, int lodLevels = 1): layout(std::move(layout)) {
+        std::vector<unsigned char> vertexData, indexData;
+        create(build(mesh, this->layout, vertexData, indexData, optimizeOrder, lodLevels), name, false);
+    }
+    // Load .obj model through tinyobj::LoadObjWithCallback, for meshes too large to hold in memory more than
+    // once. only the attributes of the file are kept whole, triangles go through fixed size staging buffers
+    // flushed into the vertex and index buffers whenever they fill, and corners are deduplicated against a
+    // fixed size table of recent vertices, so memory beyond the attributes is bounded whatever the size of
+    // the file. repeats the table has evicted become extra vertices. vertices are interleaved floats with
+    // 32-bit indices, as neither count is known before the end of the file, in the triangle order of the
+    // file and without levels of detail. a valid mesh cache with optimized order and no levels is used instead
+    static std::shared_ptr<Model> stream(const std::string& filename, size_t stagingSize = STAGING_SIZE) {
+        std::shared_ptr<Model> model(new Model());
+        std::unique_ptr<MappedFile> cacheFile;
+        MeshCache::Mesh cached;
+        struct stat cacheStat{}, sourceStat{};
+        // a missing OBJ accepts any cache, one that exists but cannot be read skips it and fails below
+        uint64_t sourceHash = 0;
+        const bool sourceKnown = stat(filename.c_str(), &sourceStat) != 0 || MeshCache::hash(filename, sourceHash);
+        if (sourceKnown && stat(MeshCache::pathFor(filename).c_str(), &cacheStat) == 0 &&
+            MeshCache::load(filename, sourceHash, model->layout, true, 1, cacheFile, cached)) {
+            model->create(cached, filename, true);
+            return model;
+        }
+        std::ifstream file(filename, std::ios::binary);
+        if (!file) {
+            std::cout << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << filename << std::endl;
+            exit(1);
+        }
+        StreamingImport import(*model, stagingSize);
+        tinyobj::callback_t callback;
+        callback.vertex_cb = [](void* user, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t) {
+            static_cast<StreamingImport*>(user)->positions.insert(static_cast<StreamingImport*>(user)->positions.end(), {x, y, z});
+        };
+        callback.normal_cb = [](void* user, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+            static_cast<StreamingImport*>(user)->normals.insert(static_cast<StreamingImport*>(user)->normals.end(), {x, y, z});
+        };
+        callback.texcoord_cb = [](void* user, tinyobj::real_t u, tinyobj::real_t v, tinyobj::real_t) {
+            static_cast<StreamingImport*>(user)->texcoords.insert(static_cast<StreamingImport*>(user)->texcoords.end(), {u, v});
+        };
+        callback.index_cb = [](void* user, tinyobj::index_t* corners, int count) {
+            static_cast<StreamingImport*>(user)->face(corners, count);
+        };
+        std::string warn, err;
+        if (!tinyobj::LoadObjWithCallback(file, callback, &import, nullptr, &warn, &err) || import.failed) {
+            std::cout << "ERROR::MODEL::PARSE_FAILED: " << filename << ", " << (import.failed ? import.error : err) << std::endl;
+            exit(1);
+        }
+        import.finish();
+        printf("Streamed model \"%s\" through %.1f KB of staging, %d vertices for %d corners (%.1f%% fewer), "
+               "%.1f KB of attributes held\n",
+               filename.c_str(), 2 * stagingSize / 1024.0, model->vertexCount, model->indexCount,
+               100.0 * (model->indexCount - model->vertexCount) / std::max(model->indexCount, 1),
+               (import.positions.capacity() + import.normals.capacity() + import.texcoords.capacity()) * sizeof(float) / 1024.0);
+        printf("  triangle order of the source, ACMR %.3f, ATVR %.3f with a %u vertex cache\n",
+               static_cast<double>(import.cacheMisses) / std::max(model->indexCount / 3, 1),
+               static_cast<double>(import.cacheMisses) / std::max(model->vertexCount, 1), MeshOptimizer::CACHE_SIZE);
+        return model;
+    }
+
+    ~Model() {
+        if (allocation.block) {
+            GeometryArena::get().release(allocation);
+            return;
+        }
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &vbo);
+        glDeleteBuffers(1, &ebo);
+        RenderState::get().forgetVertexArray(vao);
+    }
+
+    void bind() const {
+        RenderState::get().bindVertexArray(vao);
+    }
+    // draw a level of detail, the full mesh by default. the vertex array has to be bound
+    void draw(size_t lod = 0) const {
+        const size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t);
+        glDrawElementsBaseVertex(GL_TRIANGLES, static_cast<GLsizei>(lods[lod].indexCount), indexType,
+                                 (GLvoid*)(allocation.indexOffset + lods[lod].firstIndex * indexSize),
+                                 allocation.baseVertex);
+    }
 
-        // also re-calculate the right and up vector
+    // one vertex for every distinct position, normal and texture coordinate the faces reference,
+    // missing attributes read as zero
+    static void buildVertices(const ObjMesh& mesh, std::vector<float>& vertices, std::vector<float>& normals,
+                              std::vector<float>& tex_coords, std::vector<uint32_t>& indices) {
+        std::unordered_map<tinyobj::index_t, uint32_t, CornerHash, CornerEqual> uniqueVertices;
+        uniqueVertices.reserve(mesh.indices.size());
+        indices.reserve(mesh.indices.size());
+        for (const tinyobj::index_t& idx : mesh.indices) {
+            auto inserted = uniqueVertices.emplace(idx, static_cast<uint32_t>(uniqueVertices.size()));
+            indices.push_back(inserted.first->second);
+            if (!inserted.second)
+                continue;
+            vertices.push_back(mesh.positions[3 * idx.vertex_index + 0]);
+            vertices.push_back(mesh.positions[3 * idx.vertex_index + 1]);
+            vertices.push_back(mesh.positions[3 * idx.vertex_index + 2]);
+            for (int c = 0; c < 3; ++c)
+                normals.push_back(idx.normal_index >= 0 ? mesh.normals[3 * idx.normal_index + c] : 0.0f);
+            for (int c = 0; c < 2; ++c)
+                tex_coords.push_back(idx.texcoord_index >= 0 ? mesh.texcoords[2 * idx.texcoord_index + c] : 0.0f);
+        }
+    }
+    // buffer data of the vertices in layout. quantized layouts get unorm16 positions and texture
+    // coordinates mapped into the bounds of the mesh, half float positions centered in them and
+    // octahedral normals, decode is set to undo that
+    static std::vector<unsigned char> encodeVertices(const VertexLayout& layout, const std::vector<float>& vertices,
+                                                     const std::vector<float>& normals, const std::vector<float>& tex_coords,
+                                                     VertexDecode& decode) {
+        const size_t count = vertices.size() / 3;
+        decode = VertexDecode();
+        if (!layout.quantized)
+            return layout.pack({vertices.data(), normals.data(), tex_coords.data()}, count);
 
-        // normalize the vectors, because their length gets closer to 0 the more you look up or down
-        // which results in slower movement.
-        right = glm::normalize(glm::cross(front, worldUp));
-        up = glm::normalize(glm::cross(right, front));
+        std::vector<float> positions(vertices), octahedral(count * 2), coordinates(tex_coords);
+        glm::vec3 positionMin, positionMax;
+        bounds(positions, 3, &positionMin[0], &positionMax[0]);
+        if (layout.attributes[0].type == GL_UNSIGNED_SHORT) {
+            decode.positionScale = positionMax - positionMin;
+            decode.positionOffset = positionMin;
+        } else {
+            decode.positionOffset = (positionMin + positionMax) * 0.5f;
+        }
+        for (size_t i = 0; i < positions.size(); ++i) {
+            const float scale = decode.positionScale[i % 3];
+            positions[i] = scale > 0.0f ? (positions[i] - decode.positionOffset[i % 3]) / scale : 0.0f;
+        }
+        glm::vec2 texcoordMin, texcoordMax;
+        bounds(coordinates, 2, &texcoordMin[0], &texcoordMax[0]);
+        decode.texcoordTransform = glm::vec4(texcoordMax - texcoordMin, texcoordMin);
+        for (size_t i = 0; i < coordinates.size(); ++i) {
+            const float scale = decode.texcoordTransform[i % 2];
+            coordinates[i] = scale > 0.0f ? (coordinates[i] - texcoordMin[i % 2]) / scale : 0.0f;
+        }
+        for (size_t v = 0; v < count; ++v) {
+            glm::vec3 normal(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]);
+            glm::vec2 encoded = glm::length(normal) > 0.0f ? VertexDecode::encodeNormal(normal) : glm::vec2(0.0f);
+            octahedral[v * 2] = encoded.x;
+            octahedral[v * 2 + 1] = encoded.y;
+        }
+        return layout.pack({positions.data(), octahedral.data(), coordinates.data()}, count);
     }
-};
-class Texture {
+
+    // vertex and index buffer contents of mesh in layout, vertexData and indexData hold the bytes the
+    // result points to. indices are 16-bit while the vertices fit. optimizeOrder reorders the triangles
+    // for the vertex cache, then for overdraw, and the vertices in the order the triangles use them.
+    // lodLevels above 1 appends levels of detail, each simplified to about half the triangles of the
+    // one before, while their error stays within LOD_ERROR_LIMIT of the radius
+    static MeshCache::Mesh build(const ObjMesh& mesh, const VertexLayout& layout, std::vector<unsigned char>& vertexData,
+                                 std::vector<unsigned char>& indexData, bool optimizeOrder = false, int lodLevels = 1) {
+        std::vector<float> vertices, normals, tex_coords;
+        std::vector<uint32_t> indices;
+        buildVertices(mesh, vertices, normals, tex_coords, indices);
+        MeshCache::Mesh built;
+        built.sourceOrder = MeshOptimizer::analyze(indices, vertices.size() / 3);
+        if (optimizeOrder) {
+            // sources exported in strips can already beat tipsify, their order is kept then
+            std::vector<uint32_t> sourceIndices = indices;
+            MeshOptimizer::optimizeVertexCache(indices, vertices.size() / 3);
+            if (MeshOptimizer::analyze(indices, vertices.size() / 3).acmr > built.sourceOrder.acmr)
+                indices.swap(sourceIndices);
+            MeshOptimizer::optimizeOverdraw(indices, vertices);
+        }
+        built.optimized = optimizeOrder;
+        built.drawOrder = MeshOptimizer::analyze(indices, vertices.size() / 3);
+        sphereBounds(vertices, built.center, built.radius);
+        built.lodLevels = lodLevels;
+        built.lods = {{0, static_cast<uint32_t>(indices.size()), 0.0f}};
+        if (lodLevels > 1) {
+            // every level indexes the same vertices, the element buffer holds them one after the other
+            MeshOptimizer::Simplifier simplifier(indices, vertices);
+            std::vector<uint32_t> levels = indices;
+            while (built.lods.size() < std::min<size_t>(lodLevels, MeshCache::MAX_LODS)) {
+                const size_t previous = built.lods.back().indexCount;
+                simplifier.simplify(previous / 6 * 3, LOD_ERROR_LIMIT * built.radius);
+                std::vector<uint32_t> level = simplifier.indices();
+                // a level that saves little is not worth its indices
+                if (level.empty() || level.size() * 10 > previous * 9)
+                    break;
+                if (optimizeOrder)
+                    MeshOptimizer::optimizeVertexCache(level, vertices.size() / 3);
+                built.lods.push_back({static_cast<uint32_t>(levels.size()), static_cast<uint32_t>(level.size()), simplifier.error()});
+                levels.insert(levels.end(), level.begin(), level.end());
+            }
+            indices.swap(levels);
+        }
+        // levels only use vertices of the full mesh, so they come first
+        if (optimizeOrder)
+            MeshOptimizer::optimizeVertexFetch(indices, {{&vertices, 3}, {&normals, 3}, {&tex_coords, 2}});
+        built.vertexCount = static_cast<int>(vertices.size() / 3);
+        built.indexCount = static_cast<int>(indices.size());
+        vertexData = encodeVertices(layout, vertices, normals, tex_coords, built.decode);
+        if (built.vertexCount <= 65536) {
+            std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+            built.indexType = GL_UNSIGNED_SHORT;
+            indexData.resize(shortIndices.size() * sizeof(uint16_t));
+            memcpy(indexData.data(), shortIndices.data(), indexData.size());
+        } else {
+            built.indexType = GL_UNSIGNED_INT;
+            indexData.resize(indices.size() * sizeof(uint32_t));
+            memcpy(indexData.data(), indices.data(), indexData.size());
+        }
+        built.vertices = vertexData.data();
+        built.vertexSize = vertexData.size();
+        built.indices = indexData.data();
+        built.indexSize = indexData.size();
+        return built;
+    }
+
 private:
-    struct TextureData {
-        TextureData(): width(0), height(0), data(nullptr) {}
+    static const size_t STAGING_SIZE = 1 << 20; // bytes, for vertices and indices each
+    static const size_t DEDUP_SLOTS = 1 << 16;
+    static constexpr float LOD_ERROR_LIMIT = 0.2f; // of the bounding radius
 
-        int width;
-        int height;
-        unsigned char* data;
-    };
+    Model(): layout(VertexLayout::standard(true)) {}
 
-public:
-    GLuint texture = 0;
+    // state of Model::stream while tinyobj calls back
+    struct StreamingImport {
+        Model& model;
+        std::vector<float> positions, normals, texcoords;
+        std::vector<float> vertexStaging; // standard(true) records
+        std::vector<uint32_t> indexStaging;
+        size_t vertexCapacity = 0, indexCapacity = 0; // bytes in the buffer objects
+        size_t vertexBytes = 0; // flushed so far
+        int faces = 0;
+        // the cache model of MeshOptimizer, as a FIFO so it needs no state per vertex
+        uint32_t cache[MeshOptimizer::CACHE_SIZE];
+        size_t cacheNext = 0, cacheMisses = 0;
+        // direct mapped, a corner that finds another one in its slot replaces it
+        struct Slot {
+            tinyobj::index_t corner;
+            uint32_t vertex;
+        };
+        std::vector<Slot> recent;
+        bool failed = false;
+        std::string error;
 
-    // load a png image and return a TextureData structure with raw data
-    // not limited to png format. works with any image format that is RGBA-32bit
-    static TextureData loadImg(const std::string& imgFilePath) {
-        TextureData textureData;
-        int components;
-
-        // load the textureData with stb image, force RGBA (4 components required)
-        stbi_uc *data = stbi_load(imgFilePath.c_str(), &textureData.width, &textureData.height, &components, 4);
-
-        // is the image successfully loaded?
-        if (data != nullptr) {
-            // copy the raw data
-            size_t dataSize = textureData.width * textureData.height * 4 * sizeof(unsigned char);
-            textureData.data = new unsigned char[dataSize];
-            memcpy(textureData.data, data, dataSize);
-
-            // mirror the image vertically to comply with OpenGL convention
-            for (size_t i = 0; i < textureData.width; ++i) {
-                for (size_t j = 0; j < textureData.height / 2; ++j) {
-                    for (size_t k = 0; k < 4; ++k) {
-                        size_t coord1 = (j * textureData.width + i) * 4 + k;
-                        size_t coord2 = ((textureData.height - j - 1) * textureData.width + i) * 4 + k;
-                        std::swap(textureData.data[coord1], textureData.data[coord2]);
+        StreamingImport(Model& model, size_t stagingSize): model(model) {
+            vertexStaging.reserve(std::max<size_t>(stagingSize / sizeof(float) / 8, 1) * 8);
+            indexStaging.reserve(std::max<size_t>(stagingSize / sizeof(uint32_t) / 3, 1) * 3);
+            Slot empty{};
+            empty.corner.vertex_index = -1;
+            recent.assign(DEDUP_SLOTS, empty);
+            std::fill(std::begin(cache), std::end(cache), UINT32_MAX);
+            glGenBuffers(1, &model.vbo);
+            glGenBuffers(1, &model.ebo);
+        }
+        // raw OBJ index, 1-based, negative ones count back from the last element read and 0 where missing
+        static bool resolve(int& index, size_t count, bool required) {
+            if (index == 0) {
+                index = -1;
+                return !required;
+            }
+            index = index > 0 ? index - 1 : static_cast<int>(count) + index;
+            return ObjMesh::inRange(index, count);
+        }
+        // triangulated as a fan around the first corner like ObjMesh
+        void face(tinyobj::index_t* corners, int count) {
+            if (failed)
+                return;
+            ++faces;
+            for (int i = 0; i < count; ++i) {
+                tinyobj::index_t& corner = corners[i];
+                if (!resolve(corner.vertex_index, positions.size() / 3, true) ||
+                    !resolve(corner.texcoord_index, texcoords.size() / 2, false) ||
+                    !resolve(corner.normal_index, normals.size() / 3, false)) {
+                    failed = true;
+                    error = "index out of range in face " + std::to_string(faces);
+                    return;
+                }
+            }
+            if (count < 3) {
+                failed = true;
+                error = "fewer than three corners in face " + std::to_string(faces);
+                return;
+            }
+            for (int i = 2; i < count; ++i) {
+                for (int corner : {0, i - 1, i}) {
+                    const uint32_t index = vertex(corners[corner]);
+                    if (std::find(std::begin(cache), std::end(cache), index) == std::end(cache)) {
+                        cache[cacheNext] = index;
+                        cacheNext = (cacheNext + 1) % MeshOptimizer::CACHE_SIZE;
+                        ++cacheMisses;
                     }
+                    indexStaging.push_back(index);
+                    if (indexStaging.size() == indexStaging.capacity())
+                        flushIndices();
                 }
             }
-
-            // release the loaded image
-            stbi_image_free(data);
         }
+        uint32_t vertex(const tinyobj::index_t& corner) {
+            Slot& slot = recent[CornerHash()(corner) & (DEDUP_SLOTS - 1)];
+            if (CornerEqual()(slot.corner, corner))
+                return slot.vertex;
+            for (int c = 0; c < 3; ++c)
+                vertexStaging.push_back(positions[3 * corner.vertex_index + c]);
+            for (int c = 0; c < 3; ++c)
+                vertexStaging.push_back(corner.normal_index >= 0 ? normals[3 * corner.normal_index + c] : 0.0f);
+            for (int c = 0; c < 2; ++c)
+                vertexStaging.push_back(corner.texcoord_index >= 0 ? texcoords[2 * corner.texcoord_index + c] : 0.0f);
+            if (vertexStaging.size() == vertexStaging.capacity())
+                flushVertices();
+            slot = {corner, static_cast<uint32_t>(model.vertexCount)};
+            return static_cast<uint32_t>(model.vertexCount++);
+        }
+        void flushVertices() {
+            append(model.vbo, vertexCapacity, vertexBytes, vertexStaging.data(), vertexStaging.size() * sizeof(float));
+            vertexBytes += vertexStaging.size() * sizeof(float);
+            vertexStaging.clear();
+        }
+        void flushIndices() {
+            append(model.ebo, indexCapacity, static_cast<size_t>(model.indexCount) * sizeof(uint32_t),
+                   indexStaging.data(), indexStaging.size() * sizeof(uint32_t));
+            model.indexCount += static_cast<int>(indexStaging.size());
+            indexStaging.clear();
+        }
+        // write size bytes at offset used, doubling the buffer object when they do not fit. the copy
+        // targets leave the array and element bindings of the vertex arrays alone
+        static void append(GLuint& buffer, size_t& capacity, size_t used, const void* data, size_t size) {
+            if (used + size > capacity)
+                resize(buffer, capacity, std::max(capacity * 2, used + size), used);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, static_cast<GLintptr>(used), static_cast<GLsizeiptr>(size), data);
+        }
+        static void resize(GLuint& buffer, size_t& capacity, size_t size, size_t used) {
+            GLuint resized;
+            glGenBuffers(1, &resized);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, resized);
+            glBufferData(GL_COPY_WRITE_BUFFER, static_cast<GLsizeiptr>(size), nullptr, GL_STATIC_DRAW);
+            if (used > 0) {
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, static_cast<GLsizeiptr>(used));
+            }
+            glDeleteBuffers(1, &buffer);
+            buffer = resized;
+            capacity = size;
+        }
+        // flush what is left and move the buffers into the geometry arena, or else trim them to their
+        // contents and set up a vertex array of their own
+        void finish() {
+            flushVertices();
+            flushIndices();
+            const size_t vertexSize = model.layout.size(model.vertexCount);
+            const size_t indexSize = static_cast<size_t>(model.indexCount) * sizeof(uint32_t);
+            model.indexType = GL_UNSIGNED_INT;
+            model.lods = {{0, static_cast<uint32_t>(model.indexCount), 0.0f}};
+            sphereBounds(positions, model.center, model.radius);
+            GeometryArena::Allocation& allocation = model.allocation;
+            if (GeometryArena::get().allocate(model.layout, static_cast<size_t>(model.vertexCount), indexSize, allocation)) {
+                glBindBuffer(GL_COPY_READ_BUFFER, model.vbo);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.vertexBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0,
+                                    static_cast<GLintptr>(allocation.baseVertex * model.layout.stride),
+                                    static_cast<GLsizeiptr>(vertexSize));
+                glBindBuffer(GL_COPY_READ_BUFFER, model.ebo);
+                glBindBuffer(GL_COPY_WRITE_BUFFER, allocation.indexBuffer);
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, static_cast<GLintptr>(allocation.indexOffset),
+                                    static_cast<GLsizeiptr>(indexSize));
+                glDeleteBuffers(1, &model.vbo);
+                glDeleteBuffers(1, &model.ebo);
+                model.useArena();
+                return;
+            }
+            if (vertexCapacity != vertexSize)
+                resize(model.vbo, vertexCapacity, vertexSize, vertexSize);
+            if (indexCapacity != indexSize)
+                resize(model.ebo, indexCapacity, indexSize, indexSize);
+            glGenVertexArrays(1, &model.vao);
+            RenderState::get().bindVertexArray(model.vao);
+            glBindBuffer(GL_ARRAY_BUFFER, model.vbo);
+            model.layout.apply(model.vertexCount);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.ebo);
+        }
+    };
 
-        return textureData;
-    }
-
-    explicit Texture(const std::string& filename) {
-        TextureData textureData = loadImg(filename);
-
-        glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
+    void create(const MeshCache::Mesh& mesh, const std::string& name, bool cached) {
+        vertexCount = mesh.vertexCount;
+        indexCount = mesh.lods.empty() ? mesh.indexCount : static_cast<int>(mesh.lods[0].indexCount);
+        indexType = mesh.indexType;
+        decode = mesh.decode;
+        lods = mesh.lods;
+        if (lods.empty())
+            lods = {{0, static_cast<uint32_t>(mesh.indexCount), 0.0f}};
+        center = mesh.center;
+        radius = mesh.radius;
 
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, textureData.width, textureData.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, textureData.data);
-//        glGenerateMipmap(GL_TEXTURE_2D);
+        if (GeometryArena::get().allocate(layout, static_cast<size_t>(vertexCount), mesh.indexSize, allocation)) {
+            GeometryArena::upload(allocation, mesh.vertices, mesh.vertexSize, mesh.indices);
+            useArena();
+        } else {
+            glGenVertexArrays(1, &vao);
+            RenderState::get().bindVertexArray(vao);
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glGenBuffers(1, &vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            glBufferData(GL_ARRAY_BUFFER, mesh.vertexSize, mesh.vertices, GL_STATIC_DRAW);
+            layout.apply(vertexCount);
 
-        std::cout << "Loaded texture \"" << filename << "\"" << std::endl;
+            // the element buffer binding is part of the vertex array object
+            glGenBuffers(1, &ebo);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+        }
 
-        delete textureData.data;
-    }
-    ~Texture() {
-        glDeleteTextures(1, &texture);
+        const size_t arraysSize = static_cast<size_t>(indexCount) * 8 * sizeof(float);
+        const size_t indexedSize = mesh.vertexSize + mesh.indexSize;
+        printf("Loaded model \"%s\"%s, %d vertices for %d corners (%.1f%% fewer), %d-bit indices, %s %d-byte vertices, "
+               "%.1f KB instead of %.1f KB\n",
+               name.c_str(), cached ? " from the mesh cache" : "", vertexCount, indexCount,
+               100.0 * (indexCount - vertexCount) / indexCount, indexType == GL_UNSIGNED_SHORT ? 16 : 32,
+               layout.name.c_str(), layout.stride, indexedSize / 1024.0, arraysSize / 1024.0);
+        if (mesh.optimized) {
+            printf("  triangle order optimized, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f with a %u vertex cache\n",
+                   mesh.sourceOrder.acmr, mesh.drawOrder.acmr, mesh.sourceOrder.atvr, mesh.drawOrder.atvr,
+                   MeshOptimizer::CACHE_SIZE);
+        } else {
+            printf("  triangle order of the source, ACMR %.3f, ATVR %.3f with a %u vertex cache\n",
+                   mesh.drawOrder.acmr, mesh.drawOrder.atvr, MeshOptimizer::CACHE_SIZE);
+        }
+        if (lods.size() > 1) {
+            printf("  %zu levels of detail, triangles (error in %% of the radius):", lods.size());
+            for (const MeshCache::Lod& lod : lods)
+                printf(" %u (%.2f%%)", lod.indexCount / 3, radius > 0.0f ? 100.0 * lod.error / radius : 0.0);
+            printf("\n");
+        }
     }
 
-    void bind(unsigned int slot) const {
-        glActiveTexture(GL_TEXTURE0 + slot);
-        glBindTexture(GL_TEXTURE_2D, texture);
+    // sphere around the center of the bounding box of the positions
+    static void sphereBounds(const std::vector<float>& positions, glm::vec3& center, float& radius) {
+        glm::vec3 min, max;
+        bounds(positions, 3, &min[0], &max[0]);
+        center = (min + max) * 0.5f;
+        float radiusSquared = 0.0f;
+        for (size_t i = 0; i + 2 < positions.size(); i += 3) {
+            const glm::vec3 offset = glm::vec3(positions[i], positions[i + 1], positions[i + 2]) - center;
+            radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+        }
+        radius = std::sqrt(radiusSquared);
     }
-
-    static void unbind() {
-        glBindTexture(GL_TEXTURE_2D, 0);
+    // draw from the block of allocation
+    void useArena() {
+        vao = allocation.vertexArray;
+        vbo = allocation.vertexBuffer;
+        ebo = allocation.indexBuffer;
+    }
+    // smallest and largest value of every component
+    static void bounds(const std::vector<float>& values, int components, float* min, float* max) {
+        for (int c = 0; c < components; ++c) {
+            min[c] = values.empty() ? 0.0f : values[c];
+            max[c] = min[c];
+        }
+        for (size_t i = 0; i < values.size(); ++i) {
+            min[i % components] = std::min(min[i % components], values[i]);
+            max[i % components] = std::max(max[i % components], values[i]);
+        }
     }
+    struct CornerHash {
+        size_t operator()(const tinyobj::index_t& corner) const {
+            size_t hash = std::hash<int>()(corner.vertex_index);
+            hash = hash * 31 + std::hash<int>()(corner.normal_index);
+            return hash * 31 + std::hash<int>()(corner.texcoord_index);
+        }
+    };
+    struct CornerEqual {
+        bool operator()(const tinyobj::index_t& a, const tinyobj::index_t& b) const {
+            return a.vertex_index == b.vertex_index && a.normal_index == b.normal_index && a.texcoord_index == b.texcoord_index;
+        }
+    };
 };
-class Model {
+// hands out shared handles to assets keyed by canonical path, so every file is loaded once
+// no matter how many users reference it. assets nobody but the registry holds any more are
+// evicted once they stayed unused for evictAfter seconds
+template<typename T>
+class AssetRegistry {
 public:
-    GLuint vao = 0; // vertex array object
-    GLuint vbo = 0; // vertex buffer object
-    int vertexCount = 0;
-
-    // Load .obj model
-    explicit Model(const std::string& filename) {
-        tinyobj::attrib_t attrib;
-        std::vector<tinyobj::shape_t> shapes;
-        std::vector<tinyobj::material_t> materials;
-        std::string warn, err;
-
-        bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, filename.c_str());
+    typedef std::shared_ptr<T> Handle;
+    typedef std::function<Handle(const std::string&)> Loader;
 
-        if (!warn.empty())
-            std::cout << warn << std::endl;
-        if (!err.empty())
-            std::cout << err << std::endl;
-        if (!ret)
-            exit(1);
+    double evictAfter;
 
+    explicit AssetRegistry(Loader loader, double evictAfter = 10.0): evictAfter(evictAfter), loader(std::move(loader)) {}
 
-        std::vector<float> vertices, normals, tex_coords;  // if OBJ preserves vertex order, you can use element array buffer for memory efficiency
-        for (auto & shape : shapes) {  // for 'ladybug.obj', there is only one object
-            int index_offset = 0;
-            for (int f = 0; f < shape.mesh.num_face_vertices.size(); ++f) {
-                int fv = shape.mesh.num_face_vertices[f];
-                for (int v = 0; v < fv; ++v) {
-                    tinyobj::index_t idx = shape.mesh.indices[index_offset + v];
-                    vertices.push_back(attrib.vertices[3 * idx.vertex_index + 0]);
-                    vertices.push_back(attrib.vertices[3 * idx.vertex_index + 1]);
-                    vertices.push_back(attrib.vertices[3 * idx.vertex_index + 2]);
-                    normals.push_back(attrib.normals[3 * idx.normal_index + 0]);
-                    normals.push_back(attrib.normals[3 * idx.normal_index + 1]);
-                    normals.push_back(attrib.normals[3 * idx.normal_index + 2]);
-                    tex_coords.push_back(attrib.texcoords[2 * idx.texcoord_index + 0]);
-                    tex_coords.push_back(attrib.texcoords[2 * idx.texcoord_index + 1]);
-                }
-                index_offset += fv;
-                vertexCount += fv;
+    Handle get(const std::string& path) {
+        std::string key = canonicalPath(path);
+        auto it = entries.find(key);
+        if (it != entries.end())
+            return it->second.asset;
+        Entry& entry = entries[key];
+        entry.asset = loader(path);
+        entry.unusedSince = std::chrono::steady_clock::now();
+        return entry.asset;
+    }
+    // drop assets that have had no users for a while, called once per frame
+    void collect() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = entries.begin(); it != entries.end();) {
+            Entry& entry = it->second;
+            if (entry.asset.use_count() > 1) {
+                entry.unused = false;
+            } else if (!entry.unused) {
+                entry.unused = true;
+                entry.unusedSince = now;
+            } else if (std::chrono::duration<double>(now - entry.unusedSince).count() > evictAfter) {
+                std::cout << "Evicted \"" << it->first << "\"" << std::endl;
+                it = entries.erase(it);
+                continue;
             }
+            ++it;
         }
-
-        glGenVertexArrays(1, &vao);
-        glBindVertexArray(vao);
-
-        glGenBuffers(1, &vbo);
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float) + normals.size() * sizeof(float) + tex_coords.size() * sizeof(float), NULL, GL_STATIC_DRAW);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, vertices.size() * sizeof(float), vertices.data());
-        glBufferSubData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), normals.size() * sizeof(float), normals.data());
-        glBufferSubData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float) + normals.size() * sizeof(float), tex_coords.size() * sizeof(float), tex_coords.data());
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, (GLvoid*)(vertices.size() * sizeof(float)));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, (GLvoid*)(vertices.size() * sizeof(float) + normals.size() * sizeof(float)));
-        glEnableVertexAttribArray(2);
-
-        std::cout << "Loaded model \"" << filename << "\", " << vertexCount << " vertices" << std::endl;
+    }
+    size_t size() const {
+        return entries.size();
     }
 
-    void bind() const {
-        glBindVertexArray(vao);
+private:
+    struct Entry {
+        Handle asset;
+        bool unused = false;
+        std::chrono::steady_clock::time_point unusedSince;
+    };
+    Loader loader;
+    std::unordered_map<std::string, Entry> entries;
+
+    // absolute path with symbolic links and ".." resolved, the path as given if that fails
+    static std::string canonicalPath(const std::string& path) {
+#ifdef _WIN32
+        char resolved[_MAX_PATH];
+        if (_fullpath(resolved, path.c_str(), _MAX_PATH)) {
+            std::string result(resolved);
+            std::replace(result.begin(), result.end(), '/', '\\');
+            std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+            return result;
+        }
+#else
+        char* resolved = realpath(path.c_str(), nullptr);
+        if (resolved) {
+            std::string result(resolved);
+            free(resolved);
+            return result;
+        }
+#endif
+        return path;
     }
 };
 class Scene {
@@ -417,17 +4395,17 @@ public:
         glm::vec3 scale;
     };
     struct SceneNode {
-        SceneNode(Model *model, Shader *shader, Texture *texture, glm::vec3 color,
+        SceneNode(std::shared_ptr<Model> model, std::shared_ptr<Texture> texture, glm::vec3 color,
                   glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale, std::vector<KeyFrame> keyFrames = {}):
-                model(model), shader(shader), texture(texture), translation(translation), rotation(rotation), scale(scale),
+                model(std::move(model)), texture(std::move(texture)), translation(translation), rotation(rotation), scale(scale),
                 keyFrames(std::move(keyFrames)), color(color)  {}
-        SceneNode(Model *model, Shader *shader, Texture *texture, glm::vec3 color, int parent,
+        SceneNode(std::shared_ptr<Model> model, std::shared_ptr<Texture> texture, glm::vec3 color, int parent,
                   glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale, std::vector<KeyFrame> keyFrames = {}):
-                model(model), shader(shader), texture(texture), translation(translation), rotation(rotation), scale(scale),
+                model(std::move(model)), texture(std::move(texture)), translation(translation), rotation(rotation), scale(scale),
                 parent(parent), keyFrames(std::move(keyFrames)), color(color) {}
-        Model* model;
-        Shader* shader;
-        Texture* texture;
+        std::shared_ptr<Model> model;
+        Shader* shader = nullptr; // permutation picked by the scene from the node's properties
+        std::shared_ptr<Texture> texture;
         glm::vec3 color;
         glm::vec3 translation;
         glm::vec3 rotation;
@@ -437,10 +4415,31 @@ public:
         glm::vec3 animationScale{1.0};
         glm::mat4 matrix{1.0}; // translation & rotation
 //        glm::mat4 animationMatrix{1.0}; // translation & rotation
+        glm::mat4 modelMatrix{1.0}; // scene * matrix * scale, uploaded as the model matrix
+        glm::mat3 normalMatrix{1.0}; // transforms normals of the node to world space
         std::vector<KeyFrame> keyFrames;
         int parent = -1;
+        // where the texture sits once it is packed into a TextureArray, copied from the texture
+        bool textureArray = false;
+        float textureLayer = 0.0f;
+        glm::vec4 textureTransform{1.0f, 1.0f, 0.0f, 0.0f};
+        // uniform handles of the node's shader, resolved when the node is added
+        Uniform<glm::mat4> modelUniform;
+        Uniform<glm::mat3> normalMatrixUniform;
+        Uniform<glm::vec3> ambientUniform;
+        Uniform<glm::vec3> diffuseUniform;
+        Uniform<float> textureLayerUniform;
+        Uniform<glm::vec4> textureTransformUniform;
+        Uniform<glm::vec3> positionScaleUniform;
+        Uniform<glm::vec3> positionOffsetUniform;
+        Uniform<glm::vec4> texcoordTransformUniform;
+        size_t lod = 0; // level of detail of the model drawn this frame
+        float pixelsPerUnit = 0.0f; // on screen, for a model unit at the node's distance
     };
 
+    float lodPixelError = 1.0f; // error a level of detail may show on screen
+    size_t triangleBudget = 0; // per frame, levels get coarser until it is met. 0 for none
+
 private:
     const int32_t KEYFRAME_TIME = 500;
     int lastTime = 0;
@@ -449,38 +4448,76 @@ private:
     glm::vec3 scale;
     glm::mat4 matrix;
     std::vector<SceneNode> nodes = {};
+    ShaderLibrary* shaders;
+    int lightCount = 1;
+    // camera of the frame for picking levels of detail, full detail everywhere while viewportHeight is 0
+    glm::mat4 view{1.0f};
+    glm::mat4 projection{1.0f};
+    float viewportHeight = 0.0f;
+    size_t lastFrameTriangles = 0;
+    const int BUDGET_STEPS = 16; // doublings of the pixel error tried to meet the triangle budget
 
 public:
-    Scene(glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale):
-            translation(translation), rotation(rotation), scale(scale), matrix(calculateSceneMatrix()) {}
-    Scene(): translation(0.0f), rotation(0.0f), scale(1.0f), matrix(calculateSceneMatrix()) {}
+    Scene(ShaderLibrary* shaders, glm::vec3 translation, glm::vec3 rotation, glm::vec3 scale):
+            translation(translation), rotation(rotation), scale(scale), matrix(calculateSceneMatrix()), shaders(shaders) {}
+    explicit Scene(ShaderLibrary* shaders):
+            translation(0.0f), rotation(0.0f), scale(1.0f), matrix(calculateSceneMatrix()), shaders(shaders) {}
     void addNodes(const std::vector<SceneNode>& _nodes) { // add nodes to scene
+        size_t first = nodes.size();
         nodes.insert(nodes.end(), _nodes.begin(), _nodes.end());
+        for (size_t i = first; i < nodes.size(); ++i)
+            assignShader(nodes[i]);
         updateMatrices();
     }
+    void setLightCount(int count) { // number of lights in LightData, picks new permutations
+        lightCount = count;
+        for (auto& node: nodes)
+            assignShader(node);
+    }
     SceneNode getNode(int position) { // get node from scene
         return nodes[position];
     }
     void updateNode(int position, SceneNode node) { // update node
         nodes[position] = std::move(node);
+        assignShader(nodes[position]);
         updateMatrices();
     }
+    // camera the next frames are drawn for, viewportHeight in pixels
+    void setView(const glm::mat4& _view, const glm::mat4& _projection, float _viewportHeight) {
+        view = _view;
+        projection = _projection;
+        viewportHeight = _viewportHeight;
+    }
+    size_t drawnTriangles() const { // in the last frame
+        return lastFrameTriangles;
+    }
     void draw() { // render the scene
+        selectLods();
         for (auto& node: nodes) {
-            glm::mat4 model_matrix = glm::mat4(matrix);
-            model_matrix = model_matrix * node.matrix;
-            model_matrix = glm::scale(model_matrix, node.scale);
-            model_matrix = glm::scale(model_matrix, node.animationScale);
+            // textures are packed when they finish loading, switch to the array permutation then
+            if (node.texture && node.textureArray != inTextureArray(node))
+                assignShader(node);
             node.shader->use();
-            node.shader->setMat4("model", model_matrix);
-            if(node.texture){
+            Shader::set(node.modelUniform, node.modelMatrix);
+            Shader::set(node.normalMatrixUniform, node.normalMatrix);
+            if (node.textureArray) {
+                // nodes of one array repeat its texture and sampler, RenderState skips those binds
+                node.texture->bind(0);
+                Shader::set(node.textureLayerUniform, node.textureLayer);
+                Shader::set(node.textureTransformUniform, node.textureTransform);
+            } else if(node.texture){
                 node.texture->bind(0);
             }else{
-                node.shader->setVec3("material.ambient", node.color);
-                node.shader->setVec3("material.diffuse", node.color);
+                Shader::set(node.ambientUniform, node.color);
+                Shader::set(node.diffuseUniform, node.color);
+            }
+            if (node.model->layout.quantized) {
+                Shader::set(node.positionScaleUniform, node.model->decode.positionScale);
+                Shader::set(node.positionOffsetUniform, node.model->decode.positionOffset);
+                Shader::set(node.texcoordTransformUniform, node.model->decode.texcoordTransform);
             }
             node.model->bind();
-            glDrawArrays(GL_TRIANGLES, 0, node.model->vertexCount);
+            node.model->draw(node.lod);
         }
     }
     void updateSceneVectors(glm::vec3 _translation, glm::vec3 _rotation, glm::vec3 _scale) {
@@ -543,9 +4580,74 @@ public:
             translation += glm::vec3(-1.0, 0.0, 0.0) * velocity;
         if (direction == RIGHT)
             translation += glm::vec3(1.0, 0.0, 0.0) * velocity;
-        matrix = calculateSceneMatrix();
+        updateMatrices();
+    }
+    size_t nodeCount() const {
+        return nodes.size();
     }
 private:
+    // the coarsest level of every node whose error covers at most lodPixelError pixels, from the bounding
+    // sphere of its model and the projection. while the frame is over triangleBudget the allowed error doubles
+    void selectLods() {
+        // pixels a unit at distance 1 covers
+        const float pixelsAtUnitDistance = projection[1][1] * viewportHeight * 0.5f;
+        for (auto& node: nodes) {
+            const glm::vec3 center = glm::vec3(view * node.modelMatrix * glm::vec4(node.model->center, 1.0f));
+            const float scale = std::max({glm::length(glm::vec3(node.modelMatrix[0])), glm::length(glm::vec3(node.modelMatrix[1])),
+                                          glm::length(glm::vec3(node.modelMatrix[2]))});
+            const float distance = glm::length(center);
+            // full detail for the camera inside the bounds
+            node.pixelsPerUnit = distance > node.model->radius * scale ? pixelsAtUnitDistance * scale / distance
+                                                                       : std::numeric_limits<float>::infinity();
+        }
+        float pixelError = lodPixelError;
+        for (int step = 0; ; ++step) {
+            size_t triangles = 0;
+            for (auto& node: nodes) {
+                node.lod = 0;
+                if (viewportHeight > 0.0f) {
+                    while (node.lod + 1 < node.model->lods.size() &&
+                           node.model->lods[node.lod + 1].error * node.pixelsPerUnit <= pixelError)
+                        ++node.lod;
+                }
+                triangles += node.model->lods[node.lod].indexCount / 3;
+            }
+            lastFrameTriangles = triangles;
+            if (viewportHeight <= 0.0f || triangleBudget == 0 || triangles <= triangleBudget || step == BUDGET_STEPS)
+                return;
+            pixelError *= 2.0f;
+        }
+    }
+    static bool inTextureArray(const SceneNode& node) {
+        return node.texture && node.texture->array && node.texture->resident();
+    }
+    ShaderPermutation permutationFor(const SceneNode& node) const {
+        ShaderPermutation permutation;
+        permutation.hasTexture = node.texture != nullptr;
+        permutation.textureArray = inTextureArray(node);
+        permutation.quantized = node.model->layout.quantized;
+        permutation.numLights = lightCount;
+        return permutation;
+    }
+    void assignShader(SceneNode& node) {
+        node.shader = shaders->get(permutationFor(node));
+        node.modelUniform = node.shader->getUniform<glm::mat4>("model");
+        node.normalMatrixUniform = node.shader->getUniform<glm::mat3>("normalMatrix");
+        node.ambientUniform = node.shader->getUniform<glm::vec3>("material.ambient");
+        node.diffuseUniform = node.shader->getUniform<glm::vec3>("material.diffuse");
+        node.textureArray = inTextureArray(node);
+        if (node.textureArray) {
+            node.textureLayer = static_cast<float>(node.texture->layer);
+            node.textureTransform = node.texture->uvTransform;
+            node.textureLayerUniform = node.shader->getUniform<float>("textureLayer");
+            node.textureTransformUniform = node.shader->getUniform<glm::vec4>("textureTransform");
+        }
+        if (node.model->layout.quantized) {
+            node.positionScaleUniform = node.shader->getUniform<glm::vec3>("positionScale");
+            node.positionOffsetUniform = node.shader->getUniform<glm::vec3>("positionOffset");
+            node.texcoordTransformUniform = node.shader->getUniform<glm::vec4>("texcoordTransform");
+        }
+    }
     glm::mat4 calculateSceneMatrix() {
         glm::mat4 scene_model_matrix(1.0f);
         scene_model_matrix = glm::translate(scene_model_matrix, translation);
@@ -567,21 +4669,42 @@ private:
             model_matrix = model_matrix * glm::mat4(glm::quat(glm::radians(node.rotation)));
             model_matrix = model_matrix * glm::mat4(node.animationRotation);
             node.matrix = model_matrix;
+
+            glm::vec3 node_scale = node.scale * node.animationScale;
+            node.modelMatrix = glm::scale(matrix * node.matrix, node_scale);
+            glm::mat3 linear(node.modelMatrix);
+            if (isUniform(scale) && isUniform(node_scale)) {
+                // rotation times a uniform scale, the length is normalized away in the fragment shader
+                node.normalMatrix = linear;
+            } else {
+                node.normalMatrix = glm::transpose(glm::inverse(linear));
+            }
         }
     }
+    static bool isUniform(const glm::vec3& v) {
+        const float epsilon = 1e-6f;
+        return std::abs(v.x - v.y) <= epsilon * std::abs(v.x) && std::abs(v.x - v.z) <= epsilon * std::abs(v.x);
+    }
 };
 
-Shader *materialShader;
-Shader *textureShader;
-Model* capsule;
-Model* cube;
-Model* cylinder;
-Model* plane;
-Model* sphere;
-Texture* texture;
+ShaderLibrary *shaders;
+TextureLoader *textureLoader;
+TexturePacker *texturePacker;
+AssetRegistry<Model> *models;
+AssetRegistry<Texture> *textures;
+std::shared_ptr<Model> capsule;
+std::shared_ptr<Model> cube;
+std::shared_ptr<Model> cylinder;
+std::shared_ptr<Model> plane;
+std::shared_ptr<Model> sphere;
+std::shared_ptr<Texture> texture;
 Scene *scene;
 Camera *camera;
 glm::mat4 projection_matrix(1.0f);
+float viewport_height = 0.0f; // pixels, for picking levels of detail
+
+UniformBuffer<FrameData> *frameUniforms;
+UniformBuffer<LightData> *lightUniforms;
 float model_rotation = 0.0f;
 
 const uint32_t SCREEN_WIDTH = 1000;
@@ -595,6 +4718,11 @@ float lastFrame = 0.0f;
 //imgui state
 bool run_animation = true;
 bool capture_mouse = false;
+bool quantize_vertices = false; // load models with the quantized vertex layout (--quantize-vertices)
+bool stream_models = false; // import models with Model::stream (--stream-models)
+bool optimize_triangle_order = true; // reorder triangles for the vertex cache (--keep-triangle-order)
+int lod_levels = 4; // levels of detail generated for every model, 1 for the full mesh only (--lod-levels <n>)
+size_t triangle_budget = 0; // per frame, 0 for none (--triangle-budget <n>)
 
 
 static void GLAPIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
@@ -605,73 +4733,103 @@ static void GLAPIENTRY debugMessageCallback(GLenum source, GLenum type, GLuint i
              ( type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : "" ),
              type, severity, message);
 }
+// material uniforms of a permutation, set once when its program is ready
+void setupMaterial(Shader& shader, const ShaderPermutation& permutation) {
+    shader.use();
+    if (!permutation.hasTexture) {
+        shader.setVec3("material.ambient", 0.95, 0.88, 0.325);
+        shader.setVec3("material.diffuse", 0.95, 0.88, 0.325);
+        shader.setVec3("material.specular", 0.5f, 0.5f, 0.5f);
+        shader.setFloat("material.shininess", 32.0f * 2.0f);
+    } else {
+        // diffuse and specular are scaled so textured surfaces keep
+        // their previous response (0.6, 0.5) to the shared light
+        shader.setVec3("material.ambient", glm::vec3(1.0f));
+        shader.setVec3("material.diffuse", glm::vec3(0.6f / 0.7f));
+        shader.setVec3("material.specular", glm::vec3(0.5f));
+        shader.setFloat("material.shininess", 128.0f * 4.0f);
+        shader.setInt("textureMap", 0);
+    }
+}
 void init() {
     glClearColor(0.53f, 0.81f, 0.92f, 1.0f);
-    glEnable(GL_DEPTH_TEST);
-    glDepthFunc(GL_LEQUAL);
+    RenderState::get().setEnabled(GL_DEPTH_TEST, true);
+    RenderState::get().depthFunc(GL_LEQUAL);
 
-    glEnable(GL_CULL_FACE);
-    glFrontFace(GL_CCW);
+    RenderState::get().setEnabled(GL_CULL_FACE, true);
+    RenderState::get().frontFace(GL_CCW);
 
     camera = new Camera(glm::vec3(-3.0, 1.0, 5.0), glm::vec3(0.0, 1.0, 0.0), -60.0, -7.0);
 
-    // Load shaders
-    materialShader = new Shader("shader/material.vs.glsl", "shader/material.fs.glsl");
-    textureShader = new Shader("shader/texture.vs.glsl", "shader/texture.fs.glsl");
+    // Load shaders, all programs are submitted up front and only waited on at first use
+    auto startupStart = std::chrono::steady_clock::now();
+    auto phaseStart = startupStart;
+    Shader::enableParallelCompile();
+    shaders = new ShaderLibrary("shader/uber.vs.glsl", "shader/uber.fs.glsl", setupMaterial);
+    ShaderPermutation materialPermutation, texturePermutation, textureArrayPermutation;
+    texturePermutation.hasTexture = true;
+    textureArrayPermutation.hasTexture = true;
+    textureArrayPermutation.textureArray = true;
+    materialPermutation.quantized = texturePermutation.quantized = textureArrayPermutation.quantized = quantize_vertices;
+    shaders->get(materialPermutation);
+    shaders->get(texturePermutation);
+    shaders->get(textureArrayPermutation);
+    double shaderTime = elapsedMilliseconds(phaseStart);
 
     // Load models
-    capsule = new Model("model/Capsule.obj");
-    cube = new Model("model/Cube.obj");
-    cylinder = new Model("model/Cylinder.obj");
-    plane = new Model("model/Plane.obj");
-    sphere = new Model("model/Sphere.obj");
+    phaseStart = std::chrono::steady_clock::now();
+    models = new AssetRegistry<Model>([](const std::string& path) {
+        if (stream_models)
+            return Model::stream(path);
+        if (quantize_vertices)
+            return std::make_shared<Model>(path, VertexLayout::quantizedLayout(VertexLayout::POSITION_UNORM16, VertexLayout::NORMAL_10_10_10),
+                                           optimize_triangle_order, lod_levels);
+        return std::make_shared<Model>(path, VertexLayout::standard(true), optimize_triangle_order, lod_levels);
+    });
+    capsule = models->get("model/Capsule.obj");
+    cube = models->get("model/Cube.obj");
+    cylinder = models->get("model/Cylinder.obj");
+    plane = models->get("model/Plane.obj");
+    sphere = models->get("model/Sphere.obj");
+    double modelTime = elapsedMilliseconds(phaseStart);
 
     // Load textures
-    texture = new Texture("texture/block.png");
+    phaseStart = std::chrono::steady_clock::now();
+    textureLoader = new TextureLoader();
+    texturePacker = new TexturePacker();
+    textureLoader->packer = texturePacker;
+    textures = new AssetRegistry<Texture>([](const std::string& path) { return textureLoader->load(path); });
+    texture = textures->get("texture/block.png");
+    double textureTime = elapsedMilliseconds(phaseStart);
 
-    // setup material shader
-    // setup light uniform
+    printf("Startup: shaders %.2f ms, models %.2f ms, textures %.2f ms, total %.2f ms\n",
+           shaderTime, modelTime, textureTime, elapsedMilliseconds(startupStart));
+
+    // setup shared uniform blocks
+    frameUniforms = new UniformBuffer<FrameData>(FRAME_DATA_BINDING);
+    lightUniforms = new UniformBuffer<LightData>(LIGHT_DATA_BINDING);
+
+    // setup light uniform, uploaded once and shared by every program
     glm::vec3 lightColor = glm::vec3(1.0f);
+    LightData lightData{};
+    lightData.lights[0] = {
+        glm::vec4(6.0f, 5.0f, 10.0f, 1.0f),
+        glm::vec4(lightColor * glm::vec3(0.2f), 1.0f),
+        glm::vec4(lightColor * glm::vec3(0.7f), 1.0f),
+        glm::vec4(lightColor * glm::vec3(1.0f), 1.0f),
+    };
+    lightUniforms->update(lightData);
 
-    // setup material shader
-    // setup light uniform
-    materialShader->use();
-    materialShader->setVec3("light.position", 6.0f, 5.0f, 10.0f);
-    materialShader->setVec3("light.ambient", lightColor * glm::vec3(0.2f));
-    materialShader->setVec3("light.diffuse", lightColor * glm::vec3(0.7f));
-    materialShader->setVec3("light.specular", lightColor * glm::vec3(1.0f));
-
-    // setup material uniform
-    materialShader->setVec3("material.ambient", 0.95, 0.88, 0.325);
-    materialShader->setVec3("material.diffuse", 0.95, 0.88, 0.325);
-    materialShader->setVec3("material.specular", 0.5f, 0.5f, 0.5f);
-    materialShader->setFloat("material.shininess", 32.0f);
-
-
-    // setup texture shader
-    // setup light uniform
-    textureShader->use();
-    textureShader->setVec3("light.position", 6.0f, 5.0f, 10.0f);
-    textureShader->setVec3("light.ambient", lightColor * glm::vec3(0.2f));
-    textureShader->setVec3("light.diffuse", lightColor * glm::vec3(0.6f));
-    textureShader->setVec3("light.specular", lightColor * glm::vec3(0.5f));
-
-    // setup material uniform
-    textureShader->setVec3("material.ambient", glm::vec3(1.0f));
-    textureShader->setVec3("material.diffuse", glm::vec3(1.0f));
-    textureShader->setVec3("material.specular", glm::vec3(1.0f));
-    textureShader->setFloat("material.shininess", 128.0f);
-
-
-    textureShader->setInt("textureMap", 0);
     texture->bind(0);
 
     // setup scene
-    scene = new Scene(glm::vec3(0.0, 0.0, 0.0),
+    scene = new Scene(shaders,
+                      glm::vec3(0.0, 0.0, 0.0),
                       glm::vec3(0.0, 0.0, 0.0),
                       glm::vec3(1.0));
+    scene->triangleBudget = triangle_budget;
     scene->addNodes({
-        Scene::SceneNode(cube, textureShader, texture, glm::vec3(1.0), -1, // body id 0
+        Scene::SceneNode(cube, texture, glm::vec3(1.0), -1, // body id 0
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.8, 1.0, 0.4), {
@@ -694,7 +4852,7 @@ void init() {
                                   glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                   glm::vec3(1.0, 1.0, 1.0)},
         }),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.99, 0.5, 0.44), 0, // left hand top joint id 1
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.99, 0.5, 0.44), 0, // left hand top joint id 1
                          glm::vec3(0.46, 0.4, 0.0),
                          glm::vec3(0.0, 0.0, 6.0),
                          glm::vec3(0.25, 0.25, 0.25), {
@@ -708,11 +4866,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.49, 0.69, 0.84), 1, // left hand top id 2
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.49, 0.69, 0.84), 1, // left hand top id 2
                          glm::vec3(0.03, -0.2, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.7, 0.88, 0.38), 2, // left hand bottom joint id 3
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.7, 0.88, 0.38), 2, // left hand bottom joint id 3
                          glm::vec3(0.0, -0.22, 0.0),
                          glm::vec3(-30.0, 0.0, -3.0),
                          glm::vec3(0.22, 0.22, 0.22), {
@@ -726,11 +4884,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.74, 0.49, 0.75), 3, // left hand bottom id 4
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.74, 0.49, 0.75), 3, // left hand bottom id 4
                          glm::vec3(0.0, -0.2, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(1.0, 0.71, 0.35), 0, // right hand top joint id 5
+        Scene::SceneNode(sphere, nullptr, glm::vec3(1.0, 0.71, 0.35), 0, // right hand top joint id 5
                          glm::vec3(-0.46, 0.4, 0.0),
                          glm::vec3(0.0, 0.0, -6.0),
                          glm::vec3(0.25, 0.25, 0.25), {
@@ -744,11 +4902,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(1.0, 0.93, 0.4), 5, // right hand top id 6
+        Scene::SceneNode(cube, nullptr, glm::vec3(1.0, 0.93, 0.4), 5, // right hand top id 6
                          glm::vec3(-0.03, -0.2, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.75, 0.73, 0.86), 6, // right hand bottom joint id 7
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.75, 0.73, 0.86), 6, // right hand bottom joint id 7
                          glm::vec3(0.0, -0.22, 0.0),
                          glm::vec3(-30.0, 0.0, 3.0),
                          glm::vec3(0.22, 0.22, 0.22), {
@@ -762,23 +4920,23 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.99, 0.8, 0.9), 7, // right hand bottom id 8
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.99, 0.8, 0.9), 7, // right hand bottom id 8
                          glm::vec3(0.0, -0.2, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.7, 0.83, 1.0), 0, // head id 9
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.7, 0.83, 1.0), 0, // head id 9
                          glm::vec3(0.0, 0.7, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.5, 0.5, 0.5), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.2), 9, // left eye id 10
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.2), 9, // left eye id 10
                          glm::vec3(0.1, 0.08, 0.21),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.05, 0.07, 0.05), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.2), 9, // right eye id 11
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.2), 9, // right eye id 11
                          glm::vec3(-0.1, 0.08, 0.21),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.05, 0.07, 0.05), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.92, 0.33, 0.27), 0, // left leg top joint id 12
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.92, 0.33, 0.27), 0, // left leg top joint id 12
                          glm::vec3(0.2, -0.5, 0.0),
                          glm::vec3(-0.0, 0.0, 0.0),
                          glm::vec3(0.2, 0.2, 0.2), {
@@ -792,11 +4950,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.92, 0.33, 0.27), 12, // left leg top id 13
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.92, 0.33, 0.27), 12, // left leg top id 13
                          glm::vec3(0.0, -0.27, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.94, 0.61, 0.13), 13, // left leg bottom joint id 14
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.94, 0.61, 0.13), 13, // left leg bottom joint id 14
                          glm::vec3(0.0, -0.28, 0.0),
                          glm::vec3(-0.0, 0.0, 0.0),
                          glm::vec3(0.2, 0.2, 0.2), {
@@ -810,11 +4968,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.93, 0.75, 0.2), 14, // left leg bottom id 15
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.93, 0.75, 0.2), 14, // left leg bottom id 15
                          glm::vec3(0.0, -0.22, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.4, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.93, 0.88, 0.36), 0, // right leg top joint id 16
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.93, 0.88, 0.36), 0, // right leg top joint id 16
                          glm::vec3(-0.2, -0.5, 0.0),
                          glm::vec3(-0.0, 0.0, 0.0),
                          glm::vec3(0.2, 0.2, 0.2), {
@@ -828,11 +4986,11 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.74, 0.81, 0.2), 16, // right leg top id 17
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.74, 0.81, 0.2), 16, // right leg top id 17
                          glm::vec3(0.0, -0.27, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.5, 0.13), {}),
-        Scene::SceneNode(sphere, materialShader, nullptr, glm::vec3(0.53, 0.74, 0.27), 17, // right leg bottom joint id 18
+        Scene::SceneNode(sphere, nullptr, glm::vec3(0.53, 0.74, 0.27), 17, // right leg bottom joint id 18
                          glm::vec3(0.0, -0.28, 0.0),
                          glm::vec3(-0.0, 0.0, 0.0),
                          glm::vec3(0.2, 0.2, 0.2), {
@@ -846,7 +5004,7 @@ void init() {
                                          glm::quat(glm::radians(glm::vec3(0.0, 0.0, 0.0))),
                                          glm::vec3(1.0, 1.0, 1.0)},
                          }),
-        Scene::SceneNode(cube, materialShader, nullptr, glm::vec3(0.15, 0.68, 0.94), 18, // right leg bottom id 19
+        Scene::SceneNode(cube, nullptr, glm::vec3(0.15, 0.68, 0.94), 18, // right leg bottom id 19
                          glm::vec3(0.0, -0.22, 0.0),
                          glm::vec3(0.0, 0.0, 0.0),
                          glm::vec3(0.13, 0.4, 0.13), {}),
@@ -855,22 +5013,729 @@ void init() {
 void draw() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    // projection & view matrix
-    materialShader->use();
-    materialShader->setVec3("cameraPosition", camera->position);
-    materialShader->setMat4("projection", projection_matrix);
-    materialShader->setMat4("view", camera->getViewMatrix());
+    // upload the textures the workers have decoded, within the frame's budget
+    textureLoader->update();
+    // release assets no node has used for a while
+    models->collect();
+    textures->collect();
 
-    textureShader->use();
-    textureShader->setVec3("cameraPosition", camera->position);
-    textureShader->setMat4("projection", projection_matrix);
-    textureShader->setMat4("view", camera->getViewMatrix());
+    // projection & view matrix, uploaded once for every program
+    frameUniforms->update({projection_matrix, camera->getViewMatrix(), glm::vec4(camera->position, 1.0f)});
 
     if (run_animation)
         scene->animate(static_cast<int>(deltaTime * 1000));
+    scene->setView(camera->getViewMatrix(), projection_matrix, viewport_height);
     scene->draw();
 
 }
+// time a callable in milliseconds, waiting for the GPU so queued work is not missed
+template<typename F>
+double measureMilliseconds(F&& f) {
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    f();
+    glFinish();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+// resident memory of the process in bytes, peak is the high water mark since resetPeakResident.
+// 0 where the platform does not report it
+size_t residentBytes(bool peak) {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return peak ? counters.PeakWorkingSetSize : counters.WorkingSetSize;
+#elif defined(__linux__)
+    std::ifstream status("/proc/self/status");
+    const std::string key = peak ? "VmHWM:" : "VmRSS:";
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, key.size(), key) == 0)
+            return std::stoul(line.substr(key.size())) * 1024;
+    }
+    return 0;
+#else
+    return 0;
+#endif
+}
+// restart the high water mark of residentBytes at the current size, false where that is not possible.
+// freed heap memory is handed back first, so later allocations cannot hide in it
+bool resetPeakResident() {
+#ifdef __linux__
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    std::ofstream clear("/proc/self/clear_refs");
+    clear << "5";
+    clear.close();
+    return !clear.fail();
+#else
+    return false;
+#endif
+}
+// texture preparation kernels at every level the processor supports, on random images of a few sizes.
+// the output of each level is checked against the scalar version
+void benchmarkImageKernels() {
+    const int SIZES[] = {256, 1024, 4096};
+    printf("Image kernels, best level %s:\n", ImageKernels::name(ImageKernels::supported()));
+    for (int size : SIZES) {
+        const size_t pixels = static_cast<size_t>(size) * size;
+        // about the same amount of work for every size
+        const int runs = std::max(1, 4096 * 4096 / static_cast<int>(pixels));
+        std::vector<unsigned char> rgba(pixels * 4), rgb(pixels * 3);
+        unsigned int seed = 1;
+        for (unsigned char& value : rgba)
+            value = static_cast<unsigned char>((seed = seed * 1103515245u + 12345u) >> 16);
+        ImageKernels::convertChannels(rgba.data(), 4, rgb.data(), 3, pixels);
+
+        std::vector<unsigned char> output(pixels * 4), expected;
+        auto run = [&](const char* kernel, const std::function<void()>& f) {
+            printf("  %-22s %4dx%-4d", kernel, size, size);
+            double scalarTime = 0.0;
+            for (int level = ImageKernels::SCALAR; level <= ImageKernels::supported(); ++level) {
+                ImageKernels::active() = static_cast<ImageKernels::Level>(level);
+                std::fill(output.begin(), output.end(), 0);
+                f();
+                if (level == ImageKernels::SCALAR)
+                    expected = output;
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < runs; ++i)
+                    f();
+                double time = elapsedMilliseconds(start) / runs;
+                if (level == ImageKernels::SCALAR)
+                    scalarTime = time;
+                printf("  %s %8.3f ms (%.1fx)%s", ImageKernels::name(static_cast<ImageKernels::Level>(level)), time,
+                       scalarTime / time, output == expected ? "" : " MISMATCH");
+            }
+            printf("\n");
+        };
+        run("flip rows", [&]() {
+            ImageKernels::flipRows(rgba.data(), output.data(), static_cast<size_t>(size) * 4, size);
+        });
+        run("rgb -> rgba", [&]() {
+            ImageKernels::convertChannels(rgb.data(), 3, output.data(), 4, pixels);
+        });
+        run("rgba -> rgb", [&]() {
+            ImageKernels::convertChannels(rgba.data(), 4, output.data(), 3, pixels);
+        });
+        run("downsample rgba", [&]() {
+            ImageKernels::downsample(rgba.data(), size, size, 4, false, output.data());
+        });
+        run("downsample sRGB rgba", [&]() {
+            ImageKernels::downsample(rgba.data(), size, size, 4, true, output.data());
+        });
+        run("premultiply alpha", [&]() {
+            memcpy(output.data(), rgba.data(), rgba.size());
+            ImageKernels::premultiplyAlpha(output.data(), pixels);
+        });
+    }
+    ImageKernels::active() = ImageKernels::supported();
+}
+// vertex fetch throughput of every vertex layout, with rasterization turned off so only the vertex
+// shader runs. the numbers are meant for a software implementation such as Mesa llvmpipe, where
+// fetching runs on the CPU and its caches, GPUs hide most of the difference
+void benchmarkVertexLayouts() {
+    const int GRID = 512;
+    const int DRAWS = 20;
+
+    // a GRID x GRID quad plane with every attribute indexed alike
+    ObjMesh grid;
+    for (int y = 0; y <= GRID; ++y) {
+        for (int x = 0; x <= GRID; ++x) {
+            grid.positions.insert(grid.positions.end(), {static_cast<float>(x), 0.0f, static_cast<float>(y)});
+            grid.normals.insert(grid.normals.end(), {0.0f, 1.0f, 0.0f});
+            grid.texcoords.insert(grid.texcoords.end(), {static_cast<float>(x) / GRID, static_cast<float>(y) / GRID});
+        }
+    }
+    for (int y = 0; y < GRID; ++y) {
+        for (int x = 0; x < GRID; ++x) {
+            const int corners[6] = {0, 1, GRID + 2, 0, GRID + 2, GRID + 1};
+            for (int corner : corners) {
+                const int vertex = y * (GRID + 1) + x + corner;
+                grid.indices.push_back({vertex, vertex, vertex});
+            }
+        }
+    }
+
+    const VertexLayout layouts[] = {
+        VertexLayout::standard(false),
+        VertexLayout::standard(true),
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_UNORM16, VertexLayout::NORMAL_10_10_10),
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_UNORM16, VertexLayout::NORMAL_SNORM8),
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_HALF, VertexLayout::NORMAL_10_10_10),
+    };
+    printf("Vertex fetch, rasterizer discard, %d draws on %s:\n", DRAWS, glGetString(GL_RENDERER));
+    glEnable(GL_RASTERIZER_DISCARD);
+    for (const VertexLayout& layout : layouts) {
+        Model model(grid, "grid " + std::to_string(GRID) + "x" + std::to_string(GRID), layout);
+        ShaderPermutation permutation;
+        permutation.hasTexture = true; // reads all three attributes
+        permutation.quantized = layout.quantized;
+        Shader* shader = shaders->get(permutation);
+        shader->use();
+        if (layout.quantized) {
+            Shader::set(shader->getUniform<glm::vec3>("positionScale"), model.decode.positionScale);
+            Shader::set(shader->getUniform<glm::vec3>("positionOffset"), model.decode.positionOffset);
+            Shader::set(shader->getUniform<glm::vec4>("texcoordTransform"), model.decode.texcoordTransform);
+        }
+        model.bind();
+        model.draw();
+        double time = measureMilliseconds([&]() {
+            for (int draw = 0; draw < DRAWS; ++draw)
+                model.draw();
+        });
+        const double vertices = static_cast<double>(model.indexCount) * DRAWS / time / 1000.0;
+        printf("  %-32s %2d bytes per vertex: %8.3f ms per draw, %8.1f M vertices/s, %8.1f MB/s fetched\n", model.layout.name.c_str(),
+               model.layout.stride, time / DRAWS, vertices, vertices * model.layout.stride);
+    }
+    glDisable(GL_RASTERIZER_DISCARD);
+}
+// OBJ text of a grid x grid quad height field, stands in for a large scanned mesh
+std::string gridObj(int grid) {
+    std::string text;
+    char line[96];
+    for (int y = 0; y <= grid; ++y) {
+        for (int x = 0; x <= grid; ++x) {
+            const float height = 0.05f * std::sin(x * 0.1f) * std::cos(y * 0.1f);
+            text.append(line, snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x / static_cast<float>(grid), height, y / static_cast<float>(grid)));
+            text.append(line, snprintf(line, sizeof(line), "vt %.6f %.6f\n", x / static_cast<float>(grid), y / static_cast<float>(grid)));
+            text.append(line, snprintf(line, sizeof(line), "vn 0.000000 1.000000 0.000000\n"));
+        }
+    }
+    for (int y = 0; y < grid; ++y) {
+        for (int x = 0; x < grid; ++x) {
+            const int a = y * (grid + 1) + x + 1, b = a + 1, c = a + grid + 2, d = a + grid + 1;
+            text.append(line, snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, c, c, c));
+            text.append(line, snprintf(line, sizeof(line), "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, c, c, c, d, d, d));
+        }
+    }
+    return text;
+}
+// ObjMesh::parse on one thread and on more, against tinyobj::LoadObj. the models have to come out
+// identical to tinyobj with any chunking
+void benchmarkObjParse() {
+    const int GRID = 1024;
+    auto identical = [](const ObjMesh& mesh, const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes) {
+        size_t corner = 0;
+        for (const tinyobj::shape_t& shape : shapes) {
+            for (const tinyobj::index_t& idx : shape.mesh.indices) {
+                if (corner == mesh.indices.size())
+                    return false;
+                const tinyobj::index_t& parsed = mesh.indices[corner++];
+                if (parsed.vertex_index != idx.vertex_index ||
+                    parsed.normal_index != idx.normal_index || parsed.texcoord_index != idx.texcoord_index)
+                    return false;
+            }
+        }
+        return corner == mesh.indices.size() && mesh.positions == attrib.vertices && mesh.normals == attrib.normals &&
+               mesh.texcoords == attrib.texcoords;
+    };
+    printf("OBJ parse against tinyobj::LoadObj, with 4 KB chunks for the models:\n");
+    const char* modelFiles[] = {"model/Capsule.obj", "model/Cube.obj", "model/Cylinder.obj", "model/Plane.obj", "model/Sphere.obj"};
+    for (const char* modelFile : modelFiles) {
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+        std::string warn, err;
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelFile);
+        MappedFile file(modelFile);
+        ObjMesh mesh;
+        const char* text = reinterpret_cast<const char*>(file.data());
+        const bool parsed = mesh.parse(text, text + file.size(), err, 4096);
+        printf("  %-20s %s\n", modelFile, parsed && identical(mesh, attrib, shapes) ? "identical" : "DIFFERENT");
+    }
+
+    const std::string grid = gridObj(GRID);
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+    double tinyobjTime = measureMilliseconds([&]() {
+        std::istringstream stream(grid);
+        tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, &stream);
+    });
+    printf("  grid %dx%d, %.1f MB, tinyobj::LoadObj: %9.1f ms\n", GRID, GRID, grid.size() / (1024.0 * 1024.0), tinyobjTime);
+    double single = 0.0;
+    const size_t maxThreads = ThreadPool::get().size() + 1;
+    for (size_t threads = 1; threads <= maxThreads; threads = threads < maxThreads ? std::min(threads * 2, maxThreads) : threads + 1) {
+        ObjMesh mesh;
+        double time = measureMilliseconds([&]() {
+            mesh.parse(grid.data(), grid.data() + grid.size(), err, ObjMesh::CHUNK_SIZE, threads);
+        });
+        single = threads == 1 ? time : single;
+        printf("  %2d threads, ObjMesh::parse: %9.1f ms, %6.2fx one thread, %s\n", static_cast<int>(threads), time,
+               single / time, identical(mesh, attrib, shapes) ? "identical" : "DIFFERENT");
+    }
+}
+// OBJ import against loading the mesh cache, both up to the buffer upload. besides the models a generated
+// grid stands in for a large scanned mesh, it is written next to the working directory and removed again
+void benchmarkMeshCache() {
+    const int RUNS = 5;
+    const int GRID = 512;
+    const std::string gridFile = "benchmark_grid.obj";
+    {
+        const std::string text = gridObj(GRID);
+        std::ofstream file(gridFile, std::ios::binary | std::ios::trunc);
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    GLuint buffers[2];
+    glGenBuffers(2, buffers);
+    auto upload = [&](const MeshCache::Mesh& mesh) {
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.vertexSize, mesh.vertices, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, buffers[1]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.indexSize, mesh.indices, GL_STATIC_DRAW);
+        glFinish();
+    };
+    const VertexLayout layout = VertexLayout::standard(true);
+    printf("Model import to uploaded buffers, mean of %d runs:\n", RUNS);
+    for (const std::string& modelFile : {std::string("model/Capsule.obj"), std::string("model/Sphere.obj"), gridFile}) {
+        std::remove(MeshCache::pathFor(modelFile).c_str());
+        size_t cacheSize = 0;
+        double import = measureMilliseconds([&]() {
+            for (int run = 0; run < RUNS; ++run) {
+                MappedFile file(modelFile);
+                const uint64_t sourceHash = MeshCache::hash(file.data(), file.size());
+                ObjMesh mesh;
+                std::string err;
+                const char* text = reinterpret_cast<const char*>(file.data());
+                mesh.parse(text, text + file.size(), err);
+                std::vector<unsigned char> vertexData, indexData;
+                MeshCache::Mesh built = Model::build(mesh, layout, vertexData, indexData);
+                upload(built);
+                if (run == 0)
+                    MeshCache::store(modelFile, sourceHash, layout, built);
+            }
+        }) / RUNS;
+        double cached = measureMilliseconds([&]() {
+            for (int run = 0; run < RUNS; ++run) {
+                MappedFile file(modelFile);
+                const uint64_t sourceHash = MeshCache::hash(file.data(), file.size());
+                std::unique_ptr<MappedFile> cacheFile;
+                MeshCache::Mesh mesh;
+                if (!MeshCache::load(modelFile, sourceHash, layout, false, 1, cacheFile, mesh))
+                    std::cout << "ERROR::MESH_CACHE::NOT_LOADED: " << modelFile << std::endl;
+                upload(mesh);
+                cacheSize = cacheFile->size();
+            }
+        }) / RUNS;
+        MappedFile source(modelFile);
+        printf("  %-20s %9.1f KB OBJ: %9.3f ms, %9.1f KB cache: %9.3f ms, %6.1fx\n", modelFile.c_str(),
+               source.size() / 1024.0, import, cacheSize / 1024.0, cached, import / cached);
+    }
+    glDeleteBuffers(2, buffers);
+    std::remove(gridFile.c_str());
+    std::remove(MeshCache::pathFor(gridFile).c_str());
+}
+// peak resident memory of importing a generated grid with Model::stream against the regular import.
+// streaming goes first, so memory the allocator keeps from it can only make the regular import look smaller.
+// GL buffers count as well on drivers that keep them in system memory
+void benchmarkStreamingImport() {
+    const int GRID = 512;
+    const std::string gridFile = "benchmark_grid.obj";
+    {
+        const std::string text = gridObj(GRID);
+        std::ofstream file(gridFile, std::ios::binary | std::ios::trunc);
+        file.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+    struct stat gridStat{};
+    stat(gridFile.c_str(), &gridStat);
+    printf("Model import of a %.1f MB OBJ, peak resident memory above the start:\n", gridStat.st_size / (1024.0 * 1024.0));
+    if (!resetPeakResident())
+        printf("  the peak cannot be reset on this platform, peaks are since the start of the process\n");
+    for (bool streamed : {true, false}) {
+        std::remove(MeshCache::pathFor(gridFile).c_str());
+        std::shared_ptr<Model> model;
+        resetPeakResident();
+        const size_t before = residentBytes(false);
+        double time = measureMilliseconds([&]() {
+            model = streamed ? Model::stream(gridFile) : std::make_shared<Model>(gridFile);
+        });
+        const size_t peak = residentBytes(true);
+        const size_t buffers = model->layout.size(model->vertexCount) +
+                               model->indexCount * (model->indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+        printf("  %-16s %9.1f ms, peak %8.1f MB, %8.1f MB of buffers\n", streamed ? "Model::stream:" : "Model:", time,
+               (peak > before ? peak - before : 0) / (1024.0 * 1024.0), buffers / (1024.0 * 1024.0));
+    }
+    std::remove(gridFile.c_str());
+    std::remove(MeshCache::pathFor(gridFile).c_str());
+}
+// offline check (--check-quantization), decodes the quantized layouts of every model the way the
+// vertex shader does and compares them with the float vertices against the error bounds of each format.
+// returns EXIT_FAILURE if any vertex is off by more than its bound
+int checkVertexQuantization() {
+    // largest angle between a normal and its octahedral encoding rounded to nearest, the worst
+    // of 100k random directions is 0.23 and 0.95 degrees
+    const float NORMAL_BOUND_10_10_10 = 0.25f; // degrees
+    const float NORMAL_BOUND_SNORM8 = 1.0f;
+    const char* modelFiles[] = {"model/Capsule.obj", "model/Cube.obj", "model/Cylinder.obj", "model/Plane.obj", "model/Sphere.obj"};
+    const VertexLayout layouts[] = {
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_UNORM16, VertexLayout::NORMAL_10_10_10),
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_UNORM16, VertexLayout::NORMAL_SNORM8),
+        VertexLayout::quantizedLayout(VertexLayout::POSITION_HALF, VertexLayout::NORMAL_10_10_10),
+    };
+    const VertexLayout floatLayout = VertexLayout::standard(true);
+    int failed = 0;
+
+    auto angle = [](glm::vec3 a, glm::vec3 b) {
+        return glm::degrees(std::acos(std::min(glm::dot(glm::normalize(a), glm::normalize(b)), 1.0f)));
+    };
+    // worst relative error, 1 is exactly at the bound
+    auto ratio = [](float error, float bound) {
+        return bound > 0.0f ? error / bound : (error > 0.0f ? 2.0f : 0.0f);
+    };
+    printf("Vertex quantization, errors relative to their bound (1 is at the bound):\n");
+    for (const char* modelFile : modelFiles) {
+        MappedFile file(modelFile);
+        ObjMesh mesh;
+        std::string err;
+        const char* text = reinterpret_cast<const char*>(file.data());
+        if (!file.valid() || !mesh.parse(text, text + file.size(), err)) {
+            std::cout << "ERROR::MODEL::FILE_NOT_SUCCESSFULLY_READ: " << modelFile << std::endl;
+            ++failed;
+            continue;
+        }
+        std::vector<float> vertices, normals, tex_coords;
+        std::vector<uint32_t> indices;
+        Model::buildVertices(mesh, vertices, normals, tex_coords, indices);
+        const size_t count = vertices.size() / 3;
+        printf("  %s, %d vertices, %.1f KB as floats:\n", modelFile, static_cast<int>(count), floatLayout.size(count) / 1024.0);
+
+        for (const VertexLayout& layout : layouts) {
+            VertexDecode decode;
+            std::vector<unsigned char> data = Model::encodeVertices(layout, vertices, normals, tex_coords, decode);
+            std::vector<float> positions = layout.unpack(data, count, 0);
+            std::vector<float> octahedral = layout.unpack(data, count, 1);
+            std::vector<float> coordinates = layout.unpack(data, count, 2);
+            const bool unorm = layout.attributes[0].type == GL_UNSIGNED_SHORT;
+            float positionRatio = 0.0f, texcoordRatio = 0.0f, normalError = 0.0f;
+            for (size_t v = 0; v < count; ++v) {
+                for (int c = 0; c < 3; ++c) {
+                    const float original = vertices[v * 3 + c];
+                    const float decoded = positions[v * 3 + c] * decode.positionScale[c] + decode.positionOffset[c];
+                    // half a step of the format, plus a few float roundings of the decode
+                    const float slack = 4.0f * FLT_EPSILON * (std::abs(original) + std::abs(decode.positionOffset[c]) + decode.positionScale[c]);
+                    const float bound = unorm ? 0.5f * decode.positionScale[c] / 65535.0f
+                                              : std::abs(original - decode.positionOffset[c]) * std::ldexp(1.0f, -11) + std::ldexp(1.0f, -25);
+                    positionRatio = std::max(positionRatio, ratio(std::abs(decoded - original), bound + slack));
+                }
+                for (int c = 0; c < 2; ++c) {
+                    const float original = tex_coords[v * 2 + c];
+                    const float decoded = coordinates[v * 2 + c] * decode.texcoordTransform[c] + decode.texcoordTransform[c + 2];
+                    const float slack = 4.0f * FLT_EPSILON * (std::abs(original) + std::abs(decode.texcoordTransform[c + 2]) + decode.texcoordTransform[c]);
+                    texcoordRatio = std::max(texcoordRatio, ratio(std::abs(decoded - original), 0.5f * decode.texcoordTransform[c] / 65535.0f + slack));
+                }
+                glm::vec3 normal(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]);
+                if (glm::length(normal) > 0.0f)
+                    normalError = std::max(normalError, angle(normal, VertexDecode::decodeNormal(glm::vec2(octahedral[v * 2], octahedral[v * 2 + 1]))));
+            }
+            const float normalBound = layout.attributes[1].type == GL_BYTE ? NORMAL_BOUND_SNORM8 : NORMAL_BOUND_10_10_10;
+            const bool pass = positionRatio <= 1.0f && texcoordRatio <= 1.0f && normalError <= normalBound;
+            failed += pass ? 0 : 1;
+            printf("    %-32s %.1f KB (%.0f%%), position %.3f, texcoord %.3f, normal %.3f deg of %.2f: %s\n",
+                   layout.name.c_str(), layout.size(count) / 1024.0, 100.0 * layout.size(count) / floatLayout.size(count),
+                   positionRatio, texcoordRatio, normalError, normalBound, pass ? "ok" : "FAILED");
+        }
+    }
+
+    // the normal bounds on evenly spread random directions, not only the ones the models use
+    unsigned int seed = 1;
+    auto random = [&seed]() {
+        seed = seed * 1103515245u + 12345u;
+        return static_cast<float>(seed >> 8) / static_cast<float>(1u << 24) * 2.0f - 1.0f;
+    };
+    for (const VertexLayout& layout : {layouts[0], layouts[1]}) {
+        const size_t count = 100000;
+        std::vector<float> directions;
+        while (directions.size() < count * 3) {
+            glm::vec3 direction(random(), random(), random());
+            if (glm::length(direction) > 0.1f && glm::length(direction) <= 1.0f)
+                directions.insert(directions.end(), {direction.x, direction.y, direction.z});
+        }
+        VertexDecode decode;
+        std::vector<unsigned char> data = Model::encodeVertices(layout, directions, directions, std::vector<float>(count * 2, 0.0f), decode);
+        std::vector<float> octahedral = layout.unpack(data, count, 1);
+        float normalError = 0.0f;
+        for (size_t v = 0; v < count; ++v) {
+            glm::vec3 direction(directions[v * 3], directions[v * 3 + 1], directions[v * 3 + 2]);
+            normalError = std::max(normalError, angle(direction, VertexDecode::decodeNormal(glm::vec2(octahedral[v * 2], octahedral[v * 2 + 1]))));
+        }
+        const float normalBound = layout.attributes[1].type == GL_BYTE ? NORMAL_BOUND_SNORM8 : NORMAL_BOUND_10_10_10;
+        failed += normalError <= normalBound ? 0 : 1;
+        printf("  %d random normals, %-16s %.3f deg of %.2f: %s\n", static_cast<int>(count),
+               layout.attributes[1].type == GL_BYTE ? "snorm8:" : "10-bit:", normalError, normalBound,
+               normalError <= normalBound ? "ok" : "FAILED");
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+// uploads of a few MB staged through PixelUploadBuffer, enough for the ring to wrap several times, each into
+// a texture of its own that is only read back once all of them are issued. the fifth one wraps while the
+// oldest live region lies past its range and two newer ones inside it. returns EXIT_FAILURE if any
+// arrived changed, which happens when the ring hands out bytes the GPU has not read yet
+int checkPixelUploads() {
+    const int WIDTH = 1024; // RGBA rows of 4 KB
+    const int HEIGHTS[] = {2560, 1280, 1024, 1024, 2304, 768, 1536, 512, 2048};
+    const int UPLOADS = sizeof(HEIGHTS) / sizeof(HEIGHTS[0]);
+    auto pattern = [](int upload, size_t i) { return static_cast<unsigned char>((i * 31 + upload * 101 + (i >> 12)) & 0xFF); };
+    PixelUploadBuffer& staging = PixelUploadBuffer::get();
+    std::vector<GLuint> textures(UPLOADS);
+    glGenTextures(UPLOADS, textures.data());
+    size_t staged = 0;
+    for (int upload = 0; upload < UPLOADS; ++upload) {
+        const size_t size = static_cast<size_t>(WIDTH) * HEIGHTS[upload] * 4;
+        RenderState::get().bindTexture(0, GL_TEXTURE_2D, textures[upload]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, WIDTH, HEIGHTS[upload]);
+        size_t offset = 0;
+        unsigned char* destination = staging.map(size, offset);
+        for (size_t i = 0; i < size; ++i)
+            destination[i] = pattern(upload, i);
+        staging.bind();
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, WIDTH, HEIGHTS[upload], GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+        staging.unbind();
+        staged += size;
+    }
+    int failed = 0;
+    std::vector<unsigned char> pixels;
+    for (int upload = 0; upload < UPLOADS; ++upload) {
+        pixels.assign(static_cast<size_t>(WIDTH) * HEIGHTS[upload] * 4, 0);
+        RenderState::get().bindTexture(0, GL_TEXTURE_2D, textures[upload]);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        for (size_t i = 0; i < pixels.size(); ++i) {
+            if (pixels[i] != pattern(upload, i)) {
+                printf("  upload %d changed at byte %zu\n", upload, i);
+                ++failed;
+                break;
+            }
+        }
+    }
+    for (GLuint texture : textures)
+        RenderState::get().forgetTexture(texture);
+    glDeleteTextures(UPLOADS, textures.data());
+    printf("Pixel upload ring, %d uploads of %.1f MB through %.1f MB: %s\n", UPLOADS, staged / (1024.0 * 1024.0),
+           PixelUploadBuffer::CAPACITY / (1024.0 * 1024.0), failed ? "CHANGED" : "intact");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+// benchmark mode (--benchmark), compares the per-draw CPU cost of the uniform update paths
+void benchmark() {
+    const int NODE_COUNT = 5000;
+    const int FRAMES = 20;
+
+    // scene with thousands of nodes laid out on a grid
+    Scene stress(shaders);
+    std::vector<Scene::SceneNode> stressNodes;
+    for (int i = 0; i < NODE_COUNT; ++i) {
+        stressNodes.emplace_back(i % 2 ? sphere : cube, nullptr,
+                                 glm::vec3((i % 7) / 7.0f, (i % 11) / 11.0f, (i % 13) / 13.0f),
+                                 glm::vec3((i % 100) * 0.3f - 15.0f, (i / 100) * 0.3f - 7.5f, -20.0f),
+                                 glm::vec3(0.0), glm::vec3(0.1));
+    }
+    stress.addNodes(stressNodes);
+
+    std::vector<glm::mat4> matrices(NODE_COUNT);
+    for (int i = 0; i < NODE_COUNT; ++i)
+        matrices[i] = glm::translate(glm::mat4(1.0), stressNodes[i].translation);
+
+    Shader* materialShader = shaders->get(ShaderPermutation());
+    materialShader->use();
+    GLuint program = materialShader->ID;
+    double driverLookup = measureMilliseconds([&]() {
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            for (int i = 0; i < NODE_COUNT; ++i) {
+                glUniformMatrix4fv(glGetUniformLocation(program, "model"), 1, GL_FALSE, &matrices[i][0][0]);
+                glUniform3fv(glGetUniformLocation(program, "material.ambient"), 1, &stressNodes[i].color[0]);
+                glUniform3fv(glGetUniformLocation(program, "material.diffuse"), 1, &stressNodes[i].color[0]);
+            }
+        }
+    });
+    double tableLookup = measureMilliseconds([&]() {
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            for (int i = 0; i < NODE_COUNT; ++i) {
+                materialShader->setMat4("model", matrices[i]);
+                materialShader->setVec3("material.ambient", stressNodes[i].color);
+                materialShader->setVec3("material.diffuse", stressNodes[i].color);
+            }
+        }
+    });
+    Uniform<glm::mat4> modelUniform = materialShader->getUniform<glm::mat4>("model");
+    Uniform<glm::vec3> ambientUniform = materialShader->getUniform<glm::vec3>("material.ambient");
+    Uniform<glm::vec3> diffuseUniform = materialShader->getUniform<glm::vec3>("material.diffuse");
+    double handles = measureMilliseconds([&]() {
+        for (int frame = 0; frame < FRAMES; ++frame) {
+            for (int i = 0; i < NODE_COUNT; ++i) {
+                Shader::set(modelUniform, matrices[i]);
+                Shader::set(ambientUniform, stressNodes[i].color);
+                Shader::set(diffuseUniform, stressNodes[i].color);
+            }
+        }
+    });
+    RenderState::get().endFrame();
+    double sceneDraw = measureMilliseconds([&]() {
+        for (int frame = 0; frame < FRAMES; ++frame)
+            stress.draw();
+    });
+    RenderState::get().endFrame();
+
+    const double draws = static_cast<double>(NODE_COUNT) * FRAMES / 1000.0; // ms -> us per draw
+    printf("Per-draw uniform update, %d nodes x %d frames:\n", NODE_COUNT, FRAMES);
+    printf("  glGetUniformLocation per call: %8.3f us\n", driverLookup / draws);
+    printf("  uniform table lookup by name:  %8.3f us\n", tableLookup / draws);
+    printf("  uniform handles:               %8.3f us\n", handles / draws);
+    printf("Scene::draw with handles:        %8.3f us per node\n", sceneDraw / draws);
+    printf("GL binds in Scene::draw:         %lu issued, %lu skipped\n",
+           RenderState::get().lastFrameIssued, RenderState::get().lastFrameSkipped);
+    printf("Geometry arena:                  %zu blocks, %.1f KB used of %.1f KB\n", GeometryArena::get().blockCount(),
+           GeometryArena::get().usedBytes() / 1024.0, GeometryArena::get().capacityBytes() / 1024.0);
+
+    // the same crowd seen through the camera, at full detail, with levels of detail and with a triangle budget
+    stress.setView(camera->getViewMatrix(), projection_matrix, viewport_height);
+    const size_t budget = NODE_COUNT * 100;
+    printf("Levels of detail in Scene::draw, %d nodes seen from the camera:\n", NODE_COUNT);
+    for (int config = 0; config < 3; ++config) {
+        stress.lodPixelError = config == 0 ? 0.0f : 1.0f;
+        stress.triangleBudget = config == 2 ? budget : 0;
+        double lodDraw = measureMilliseconds([&]() {
+            for (int frame = 0; frame < FRAMES; ++frame)
+                stress.draw();
+        });
+        RenderState::get().endFrame();
+        const std::string name = config == 0 ? "full detail:" : config == 1 ? "1 pixel error:" : "budget " + std::to_string(budget) + ":";
+        printf("  %-16s %8zu triangles, %8.3f ms per frame\n", name.c_str(), stress.drawnTriangles(), lodDraw / FRAMES);
+    }
+
+    // texture loading from the source image against the compressed cache, decode to resident
+    const std::string textureFile = "texture/block.png";
+    const unsigned int compressible = TextureLoader::compressibleChannels(false);
+    size_t decodedMemory = 0, compressedMemory = 0;
+    std::string decodedFormat, compressedFormat;
+    auto loadTexture = [&](unsigned int mask, size_t& memory, std::string& format) {
+        return measureMilliseconds([&]() {
+            for (int frame = 0; frame < FRAMES; ++frame) {
+                Texture loaded;
+                loaded.fill(TextureLoader::loadLevels(textureFile, mask));
+                memory = loaded.memorySize;
+                format = loaded.format.name;
+            }
+        }) / FRAMES;
+    };
+    // the first load builds the cache if it is missing
+    TextureLoader::loadLevels(textureFile, compressible);
+    double decodedLoad = loadTexture(0, decodedMemory, decodedFormat);
+    double compressedLoad = loadTexture(compressible, compressedMemory, compressedFormat);
+    printf("Texture \"%s\" load and upload:\n", textureFile.c_str());
+    printf("  stb_image (%s):  %8.3f ms, %8.1f KB\n", decodedFormat.c_str(), decodedLoad, decodedMemory / 1024.0);
+    printf("  cache (%s):      %8.3f ms, %8.1f KB\n", compressedFormat.c_str(), compressedLoad, compressedMemory / 1024.0);
+
+    benchmarkObjParse();
+    benchmarkMeshCache();
+    benchmarkStreamingImport();
+
+    // asset reads through stdio against the file mapping, cold runs drop the file from the page cache first
+    const int WARM_RUNS = 10;
+    auto readTime = [&](const std::string& filename, bool cold, const std::function<void()>& read) {
+        if (cold) {
+            MappedFile::evictFromCache(filename);
+            auto start = std::chrono::steady_clock::now();
+            read();
+            return elapsedMilliseconds(start);
+        }
+        read();
+        auto start = std::chrono::steady_clock::now();
+        for (int run = 0; run < WARM_RUNS; ++run)
+            read();
+        return elapsedMilliseconds(start) / WARM_RUNS;
+    };
+    auto report = [&](const std::string& filename, const char* copied, const std::function<void()>& copyRead,
+                      const char* mapped, const std::function<void()>& mappedRead) {
+        MappedFile file(filename);
+        printf("\"%s\", %.1f KB, %s:\n", filename.c_str(), file.size() / 1024.0, file.mapped() ? "mapped" : "buffered");
+        const bool evictable = MappedFile::evictFromCache(filename);
+        for (int cold = evictable ? 1 : 0; cold >= 0; --cold) {
+            double copyTime = readTime(filename, cold != 0, copyRead);
+            double mappedTime = readTime(filename, cold != 0, mappedRead);
+            printf("  %s %-24s %8.3f ms, %-24s %8.3f ms\n", cold ? "cold" : "warm", copied, copyTime, mapped, mappedTime);
+        }
+    };
+    printf("Asset reads, cold is the first read after eviction, warm the mean of %d reads:\n", WARM_RUNS);
+    const char* modelFiles[] = {"model/Capsule.obj", "model/Cube.obj", "model/Cylinder.obj", "model/Plane.obj", "model/Sphere.obj"};
+    for (const char* modelFile : modelFiles) {
+        report(modelFile, "tinyobj::LoadObj:", [&]() {
+            tinyobj::attrib_t attrib;
+            std::vector<tinyobj::shape_t> shapes;
+            std::vector<tinyobj::material_t> materials;
+            std::string warn, err;
+            tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelFile);
+        }, "ObjMesh::parse:", [&]() {
+            MappedFile file(modelFile);
+            ObjMesh mesh;
+            std::string err;
+            const char* text = reinterpret_cast<const char*>(file.data());
+            mesh.parse(text, text + file.size(), err);
+        });
+    }
+    report(textureFile, "stbi_load:", [&]() {
+        int width, height, channels;
+        stbi_image_free(stbi_load(textureFile.c_str(), &width, &height, &channels, 0));
+    }, "stbi_load_from_memory:", [&]() {
+        Texture::loadImg(textureFile);
+    });
+
+    benchmarkImageKernels();
+    benchmarkVertexLayouts();
+    checkVertexQuantization();
+    checkPixelUploads();
+}
+// offline mode (--compress-textures <images...>), builds the block-compressed caches without a GL context,
+// with mip levels filtered for linear sampling
+// and compares reading them with decoding the source through stb_image
+int compressTextures(const std::vector<std::string>& filenames) {
+    int failed = 0;
+    for (const std::string& filename : filenames) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<Texture::TextureData> levels;
+        levels.push_back(Texture::loadImg(filename));
+        if (!levels[0].data) {
+            std::cout << "ERROR::TEXTURE::FILE_NOT_SUCCESSFULLY_READ: " << filename << std::endl;
+            ++failed;
+            continue;
+        }
+        std::vector<Texture::TextureData> mipmaps = Texture::generateMipmaps(levels[0], levels[0].channels);
+        levels.insert(levels.end(), mipmaps.begin(), mipmaps.end());
+        double decodeTime = elapsedMilliseconds(start);
+
+        start = std::chrono::steady_clock::now();
+        std::vector<Texture::TextureData> compressed = CompressedTextureCache::compress(levels);
+        double encodeTime = elapsedMilliseconds(start);
+        if (!CompressedTextureCache::store(filename, compressed, false)) {
+            ++failed;
+            continue;
+        }
+
+        start = std::chrono::steady_clock::now();
+        std::vector<Texture::TextureData> cached;
+        if (!CompressedTextureCache::load(filename, cached, false)) {
+            std::cout << "ERROR::TEXTURE_CACHE::FILE_NOT_SUCCESSFULLY_READ: " << CompressedTextureCache::pathFor(filename) << std::endl;
+            ++failed;
+            continue;
+        }
+        double cacheTime = elapsedMilliseconds(start);
+
+        size_t decodedSize = 0, compressedSize = 0;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            decodedSize += levels[i].size();
+            compressedSize += cached[i].size();
+        }
+        const int channels = levels[0].channels;
+        printf("%s: %dx%d, %d level(s), %s -> %s in %.2f ms\n", filename.c_str(), levels[0].width, levels[0].height,
+               static_cast<int>(levels.size()), Texture::Format::forChannels(channels, false).name,
+               Texture::Format::forCompressedChannels(channels, false).name, encodeTime);
+        printf("  stb_image decode + mips: %8.2f ms, %8.1f KB\n", decodeTime, decodedSize / 1024.0);
+        printf("  compressed cache read:   %8.2f ms, %8.1f KB (%.1fx smaller)\n", cacheTime, compressedSize / 1024.0,
+               static_cast<double>(decodedSize) / compressedSize);
+    }
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
 void toggle_mouse(GLFWwindow* window) {
     if (!capture_mouse){
         glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -890,6 +5755,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
     float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
     projection_matrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
+    viewport_height = static_cast<float>(height);
 
     // Re-render the scene because the current frame was drawn for the old resolution
     draw();
@@ -988,6 +5854,15 @@ void prepare_imgui()
             scene->updateSceneRotation(glm::vec3(0.0f, model_rotation, 0.0f));
 
         ImGui::Text("Application %.1f FPS", io.Framerate);
+        ImGui::Text("GL binds %lu issued, %lu skipped",
+                    RenderState::get().lastFrameIssued, RenderState::get().lastFrameSkipped);
+        ImGui::Text("Texture memory %.1f KB, %zu loading, %zu arrays", Texture::totalMemory() / 1024.0,
+                    textureLoader->pendingCount(), texturePacker->arrayCount());
+        ImGui::Text("Assets %zu models, %zu textures", models->size(), textures->size());
+        ImGui::Text("Triangles %zu drawn", scene->drawnTriangles());
+        ImGui::Text("Geometry arena %zu blocks, %.1f KB used of %.1f KB", GeometryArena::get().blockCount(),
+                    GeometryArena::get().usedBytes() / 1024.0, GeometryArena::get().capacityBytes() / 1024.0);
+        ImGui::SliderFloat("LOD pixel error", &scene->lodPixelError, 0.0f, 8.0f);
         ImGui::Text("Left click to mount/unmount camera");
         ImGui::Text("E to unmount camera");
         ImGui::Text("WASD, ctrl, space to move camera");
@@ -1008,6 +5883,26 @@ void prepare_imgui()
 }
 int main(int argc, char *argv[]) {
     GLFWwindow* window;
+    bool run_benchmark = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--benchmark")
+            run_benchmark = true;
+        if (std::string(argv[i]) == "--quantize-vertices")
+            quantize_vertices = true;
+        if (std::string(argv[i]) == "--stream-models")
+            stream_models = true;
+        if (std::string(argv[i]) == "--keep-triangle-order")
+            optimize_triangle_order = false;
+        if (std::string(argv[i]) == "--lod-levels" && i + 1 < argc)
+            lod_levels = std::max(1, std::atoi(argv[++i]));
+        if (std::string(argv[i]) == "--triangle-budget" && i + 1 < argc)
+            triangle_budget = static_cast<size_t>(std::max(0, std::atoi(argv[++i])));
+        if (std::string(argv[i]) == "--check-quantization")
+            return checkVertexQuantization();
+        // the remaining arguments are images to compress, no window is opened
+        if (std::string(argv[i]) == "--compress-textures")
+            return compressTextures(std::vector<std::string>(argv + i + 1, argv + argc));
+    }
 
     glfwSetErrorCallback(error_callback);
 
@@ -1068,9 +5963,15 @@ int main(int argc, char *argv[]) {
     glViewport(0, 0, width, height);
     float aspectRatio = static_cast<float>(width) / static_cast<float>(height);
     projection_matrix = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
+    viewport_height = static_cast<float>(height);
 
     init();
 
+    if (run_benchmark) {
+        benchmark();
+        glfwSetWindowShouldClose(window, GLFW_TRUE);
+    }
+
     while (!glfwWindowShouldClose(window)) {
         glfwPollEvents();
 
@@ -1090,7 +5991,10 @@ int main(int argc, char *argv[]) {
         // Render
         ImGui::Render();
         draw();
+        RenderState::get().endFrame();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // imgui binds its own program, textures and vertex arrays
+        RenderState::get().invalidate();
 
         glfwSwapBuffers(window);
     }